@@ -17,6 +17,8 @@ void network_interrupt(int sig);
 
 /* Array of state thread control blocks: the process allows a maximum of N threads */
 static TCB t_state[N];
+/* Saved contexts, apart from t_state so that scanning it does not walk over them */
+static ucontext_t t_env[N];
 
 /* Current running thread */
 static TCB* running;
@@ -27,6 +29,7 @@ static int init=0;
 
 /* Thread control block for the idle thread */
 static TCB idle;
+static ucontext_t idle_env;
 static void idle_function(){
 	while(1);
 }
@@ -41,29 +44,35 @@ void init_mythreadlib() {
 	//Initialize processes queue
 	processes_q = queue_new();
 
+	//Every block keeps its context in t_env
+	for(i=0; i<N; i++){
+		t_state[i].run_env = &t_env[i];
+	}
+	idle.run_env = &idle_env;
+
 	/* Create context for the idle thread */
-	if(getcontext(&idle.run_env) == -1){
+	if(getcontext(idle.run_env) == -1){
 		perror("*** ERROR: getcontext in init_thread_lib");
 		exit(-1);
 	}
 	idle.state = IDLE;
 	idle.priority = SYSTEM;
 	idle.function = idle_function;
-	idle.run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
+	idle.run_env->uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
 	idle.tid = -1;
-	if(idle.run_env.uc_stack.ss_sp == NULL){
+	if(idle.run_env->uc_stack.ss_sp == NULL){
 		printf("*** ERROR: thread failed to get stack space\n");
 		exit(-1);
 	}
-	idle.run_env.uc_stack.ss_size = STACKSIZE;
-	idle.run_env.uc_stack.ss_flags = 0;
+	idle.run_env->uc_stack.ss_size = STACKSIZE;
+	idle.run_env->uc_stack.ss_flags = 0;
 	idle.ticks = QUANTUM_TICKS;
-	makecontext(&idle.run_env, idle_function, 1);
+	makecontext(idle.run_env, idle_function, 1);
 
 	t_state[0].state = INIT;
 	t_state[0].priority = LOW_PRIORITY;
 	t_state[0].ticks = QUANTUM_TICKS;
-	if(getcontext(&t_state[0].run_env) == -1){
+	if(getcontext(t_state[0].run_env) == -1){
 		perror("*** ERROR: getcontext in init_thread_lib");
 		exit(5);
 	}
@@ -95,27 +104,27 @@ int mythread_create (void (*fun_addr)(),int priority)
 	for (i=0; i<N; i++)
 		if (t_state[i].state == FREE) break;
 	if (i == N) return(-1);
-	if(getcontext(&t_state[i].run_env) == -1){
+	if(getcontext(t_state[i].run_env) == -1){
 		perror("*** ERROR: getcontext in my_thread_create");
 		exit(-1);
 	}
 	t_state[i].state = INIT;
 	t_state[i].priority = priority;
 	t_state[i].function = fun_addr;
-	t_state[i].run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
-	if(t_state[i].run_env.uc_stack.ss_sp == NULL){
+	t_state[i].run_env->uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
+	if(t_state[i].run_env->uc_stack.ss_sp == NULL){
 		printf("*** ERROR: thread failed to get stack space\n");
 		exit(-1);
 	}
 	t_state[i].tid = i;
-	t_state[i].run_env.uc_stack.ss_size = STACKSIZE;
-	t_state[i].run_env.uc_stack.ss_flags = 0;
+	t_state[i].run_env->uc_stack.ss_size = STACKSIZE;
+	t_state[i].run_env->uc_stack.ss_flags = 0;
 	t_state[i].ticks = QUANTUM_TICKS;
-	makecontext(&t_state[i].run_env, fun_addr, 1);
+	makecontext(t_state[i].run_env, fun_addr, 1);
 
 	//Insert created process into ready queue
 	enqueue(processes_q, &t_state[i]);
-	printf("*** THREAD %d READY\n", t_state[i].tid);
+	TRACE("*** THREAD %d READY\n", t_state[i].tid);
 
 	return i;
 } /****** End my_thread_create() ******/
@@ -132,13 +141,18 @@ void network_interrupt(int sig)
 }
 
 
+/* Stack of the last thread that exited */
+static void *zombie = NULL;
+
 /* Free terminated thread and exits */
 void mythread_exit() {
 	int tid = mythread_gettid();
 
-	printf("*** THREAD %d FINISHED\n", tid);
+	TRACE("*** THREAD %d FINISHED\n", tid);
 	t_state[tid].state = FREE;
-	free(t_state[tid].run_env.uc_stack.ss_sp);
+	//We still run on this stack: free it when the next thread exits
+	free(zombie);
+	zombie = t_state[tid].run_env->uc_stack.ss_sp;
 
 	//If queue is not empty we execute next process. Else, program ends.
 	if(queue_empty(processes_q) == 0){
@@ -148,7 +162,7 @@ void mythread_exit() {
 		activator(next);
 	}
 
-	printf("FINISH\n");
+	TRACE("FINISH\n");
 	exit(0);
 }
 
@@ -214,28 +228,27 @@ void activator(TCB* next){
 
 	TCB* temp = running;
 
+	//Interrupts stay disabled: the context we switch to restores its own signal mask
 	//Update tid
 	current = next->tid;
 	running = next;
 
 	if(temp->state == FREE){
-		printf("*** THREAD %d FINISHED: SET CONTEXT OF %d \n", temp->tid, current);
+		TRACE("*** THREAD %d FINISHED: SET CONTEXT OF %d \n", temp->tid, current);
 
-		enable_interrupt();
-		setcontext (&(next->run_env));
+		setcontext (next->run_env);
 		printf("mythread_free: After setcontext, should never get here!!...\n");
 	}
 	else{
 		if(temp->tid != next->tid){ //Avoid context swaping of same process
 			if(temp->state == IDLE){
-				printf("*** THREAD READY: SET CONTEXT TO %d\n", next->tid);
+				TRACE("*** THREAD READY: SET CONTEXT TO %d\n", next->tid);
 			}
 			else{
-				printf("*** SWAPCONTEXT FROM %d TO %d\n", temp->tid, next->tid);
+				TRACE("*** SWAPCONTEXT FROM %d TO %d\n", temp->tid, next->tid);
 			}
 
-			enable_interrupt();
-			swapcontext(&(temp->run_env),&(next->run_env));
+			swapcontext(temp->run_env,next->run_env);
 		}
 	}
 
@@ -17,6 +17,8 @@ void network_interrupt(int sig);
 
 /* Array of state thread control blocks: the process allows a maximum of N threads */
 static TCB t_state[N];
+/* Saved contexts, apart from t_state so that scanning it does not walk over them */
+static ucontext_t t_env[N];
 
 /* Current running thread */
 static TCB* running;
@@ -27,6 +29,7 @@ static int init=0;
 
 /* Thread control block for the idle thread */
 static TCB idle;
+static ucontext_t idle_env;
 static void idle_function(){
   while(1);
 }
@@ -43,29 +46,35 @@ void init_mythreadlib() {
 	hp_q = queue_new();
 	lp_q = queue_new();
 
+	//Every block keeps its context in t_env
+	for(i=0; i<N; i++){
+		t_state[i].run_env = &t_env[i];
+	}
+	idle.run_env = &idle_env;
+
 	/* Create context for the idle thread */
-	if(getcontext(&idle.run_env) == -1){
+	if(getcontext(idle.run_env) == -1){
 		perror("*** ERROR: getcontext in init_thread_lib");
 		exit(-1);
 	}
 	idle.state = IDLE;
 	idle.priority = SYSTEM;
 	idle.function = idle_function;
-	idle.run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
+	idle.run_env->uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
 	idle.tid = -1;
-	if(idle.run_env.uc_stack.ss_sp == NULL){
+	if(idle.run_env->uc_stack.ss_sp == NULL){
 		printf("*** ERROR: thread failed to get stack space\n");
 		exit(-1);
 	}
-	idle.run_env.uc_stack.ss_size = STACKSIZE;
-	idle.run_env.uc_stack.ss_flags = 0;
+	idle.run_env->uc_stack.ss_size = STACKSIZE;
+	idle.run_env->uc_stack.ss_flags = 0;
 	idle.ticks = QUANTUM_TICKS;
-	makecontext(&idle.run_env, idle_function, 1);
+	makecontext(idle.run_env, idle_function, 1);
 
 	t_state[0].state = INIT;
 	t_state[0].priority = LOW_PRIORITY;
 	t_state[0].ticks = QUANTUM_TICKS;
-	if(getcontext(&t_state[0].run_env) == -1){
+	if(getcontext(t_state[0].run_env) == -1){
 		perror("*** ERROR: getcontext in init_thread_lib");
 		exit(5);
 	}
@@ -97,24 +106,24 @@ int mythread_create (void (*fun_addr)(),int priority)
 	for (i=0; i<N; i++)
 		if (t_state[i].state == FREE) break;
 	if (i == N) return(-1);
-	if(getcontext(&t_state[i].run_env) == -1){
+	if(getcontext(t_state[i].run_env) == -1){
 		perror("*** ERROR: getcontext in my_thread_create\n");
 		exit(-1);
 	}
 	t_state[i].state = INIT;
 	t_state[i].priority = priority;
 	t_state[i].function = fun_addr;
-	t_state[i].run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
-	if(t_state[i].run_env.uc_stack.ss_sp == NULL){
+	t_state[i].run_env->uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
+	if(t_state[i].run_env->uc_stack.ss_sp == NULL){
 		printf("*** ERROR: thread failed to get stack space\n");
 		exit(-1);
 	}
 	t_state[i].tid = i;
-	t_state[i].run_env.uc_stack.ss_size = STACKSIZE;
-	t_state[i].run_env.uc_stack.ss_flags = 0;
+	t_state[i].run_env->uc_stack.ss_size = STACKSIZE;
+	t_state[i].run_env->uc_stack.ss_flags = 0;
 	t_state[i].ticks = QUANTUM_TICKS;
 
-	makecontext(&t_state[i].run_env, fun_addr, 1);
+	makecontext(t_state[i].run_env, fun_addr, 1);
 
 	//Insert process into its corresponding queue
 	if(t_state[i].priority == HIGH_PRIORITY){
@@ -123,7 +132,7 @@ int mythread_create (void (*fun_addr)(),int priority)
 	else{
 		enqueue(lp_q, &t_state[i]);
 	}
-	printf("*** THREAD %d READY\n", t_state[i].tid);
+	TRACE("*** THREAD %d READY\n", t_state[i].tid);
 
 	/* If low priority process is running and a high priority process arrives,
 	we stop the low priority process execution to execute the high priority one*/
@@ -131,6 +140,8 @@ int mythread_create (void (*fun_addr)(),int priority)
 		disable_interrupt();
 		disable_network_interrupt();
 		activator(scheduler());
+		enable_interrupt();
+		enable_network_interrupt();
 	}
 
 	return i;
@@ -148,13 +159,18 @@ void network_interrupt(int sig)
 }
 
 
+/* Stack of the last thread that exited */
+static void *zombie = NULL;
+
 /* Free terminated thread and exits */
 void mythread_exit() {
 	int tid = mythread_gettid();
 
-	printf("*** THREAD %d FINISHED\n", tid);
+	TRACE("*** THREAD %d FINISHED\n", tid);
 	t_state[tid].state = FREE;
-	free(t_state[tid].run_env.uc_stack.ss_sp);
+	//We still run on this stack: free it when the next thread exits
+	free(zombie);
+	zombie = t_state[tid].run_env->uc_stack.ss_sp;
 
 	//If there are still processes in any queue, we select the next process to execute
 	if(queue_empty(hp_q) == 0 || queue_empty(lp_q) == 0){
@@ -164,7 +180,7 @@ void mythread_exit() {
 		activator(next);
 	}
 
-	printf("FINISH\n");
+	TRACE("FINISH\n");
 	exit(0);
 }
 
@@ -238,48 +254,40 @@ void activator(TCB* next){
 
 	TCB * temp = running;
 
+	//Interrupts stay disabled: the context we switch to restores its own signal mask
 	//Update process tid
 	current = next->tid;
 	running = next;
 
 	//Running process finished
 	if(temp->state == FREE){
-		printf("*** THREAD %d FINISHED: SET CONTEXT OF %d \n", temp->tid, next->tid);
+		TRACE("*** THREAD %d FINISHED: SET CONTEXT OF %d \n", temp->tid, next->tid);
 
-		if(next->priority == LOW_PRIORITY){
-			enable_interrupt();
-			enable_network_interrupt();
-		}
-		setcontext (&(next->run_env));
+		setcontext (next->run_env);
 		printf("mythread_free: After setcontext, should never get here!!...\n");
 	}
 	else{
 		//Swap from low priority process to high priority one
 		if(running->priority == HIGH_PRIORITY && temp->priority == LOW_PRIORITY){
-			printf("*** THREAD %d PREEMPTED: SET CONTEXT OF %d\n", temp->tid, running->tid);
+			TRACE("*** THREAD %d PREEMPTED: SET CONTEXT OF %d\n", temp->tid, running->tid);
 
 			//TODO: Remove after tests
 			/*if(next->priority == LOW_PRIORITY){
-				enable_interrupt();
 				enable_network_interrupt();
 			}*/
-			swapcontext(&(temp->run_env),&(running->run_env));
+			swapcontext(temp->run_env,running->run_env);
 		}
 		//Standard not finished process
 		else{
 			if(temp->tid != next->tid){	//Avoid context swaping of same process
 				if(temp->state == IDLE){
-					printf("*** THREAD READY: SET CONTEXT TO %d\n", next->tid);
+					TRACE("*** THREAD READY: SET CONTEXT TO %d\n", next->tid);
 				}
 				else{
-					printf("*** SWAPCONTEXT FROM %d TO %d\n", temp->tid, next->tid);
+					TRACE("*** SWAPCONTEXT FROM %d TO %d\n", temp->tid, next->tid);
 				}
 
-				if(next->priority == LOW_PRIORITY){
-					enable_interrupt();
-					enable_network_interrupt();
-				}
-				swapcontext(&(temp->run_env),&(next->run_env));
+				swapcontext(temp->run_env,next->run_env);
 			}
 		}
 	}
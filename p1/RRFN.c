@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <ucontext.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "mythread.h"
 #include "interrupt.h"
@@ -17,6 +18,8 @@ void network_interrupt(int sig);
 
 /* Array of state thread control blocks: the process allows a maximum of N threads */
 static TCB t_state[N];
+/* Saved contexts, apart from t_state so that scanning it does not walk over them */
+static ucontext_t t_env[N];
 
 /* Current running thread */
 static TCB* running;
@@ -25,16 +28,60 @@ static int current = 0;
 /* Variable indicating if the library is initialized (init == 1) or not (init == 0) */
 static int init=0;
 
+/* Critical section nesting level and quantum expiry seen inside it */
+static volatile int no_preempt = 0;
+static volatile int preempt_pending = 0;
+
+/* Quantum bounds in ticks. The quantum is fixed to QUANTUM_TICKS unless adaptive */
+static int q_adaptive = 0;
+static int q_min = QUANTUM_TICKS;
+static int q_max = QUANTUM_TICKS;
+
+/* Low priority threads waiting in the group queues */
+static int lp_ready = 0;
+
+/* Thread group. Low priority threads are queued in the group they belong to */
+struct group{
+	int in_use; /* 1 if the group exists */
+	int parent; /* parent group, -1 for top level groups */
+	int weight; /* share of the processor relative to its siblings */
+	int quota; /* ticks per GROUP_PERIOD, 0 if unlimited */
+	int used; /* ticks used in the current period */
+	int ready; /* ready threads in the group and its descendants */
+	long vruntime; /* ticks used scaled by the inverse of the weight */
+	struct queue *q; /* ready threads of the group */
+	mythread_group_stats_t stats;
+};
+static struct group groups[MAX_GROUPS];
+
+/* Ticks elapsed in the current quota period */
+static int period_ticks = 0;
+
 /* Thread control block for the idle thread */
 static TCB idle;
+static ucontext_t idle_env;
 static void idle_function(){
 	while(1);
 }
 
-//Declare high priority and low priority queues
+//Declare high priority queue. Low priority threads wait in their group queue
 struct queue * hp_q;
-struct queue * lp_q;
-struct queue * w_q;
+
+/* Threads waiting for the network, oldest first. Only read_network adds, with the
+clock interrupt disabled, and only network_interrupt removes, so each index has a
+single writer. A thread waits at most once, so N entries are enough; one more slot
+tells a full ring from an empty one. The indices wrap at the end of the ring */
+static TCB *wait_ring[N + 1];
+static unsigned int wait_head = 0, wait_tail = 0;
+
+/* Threads woken by the interrupt handlers. The handlers push them without locks or
+malloc and the scheduler moves them to the ready queues, so the handlers never
+touch the queues (see wake_push and wake_drain) */
+static TCB *wake_head = NULL;
+
+/* Stacks start after the slab header, keeping 16 byte alignment */
+#define STACK_HDR ((sizeof(struct stack_slab) + 15) & ~((size_t) 15))
+#define STACK_BASE(slab_, k_, size_) ((char *) (slab_) + STACK_HDR + (size_t) (k_) * (size_))
 
 /* Initialize the thread library */
 void init_mythreadlib() {
@@ -42,32 +89,45 @@ void init_mythreadlib() {
 
 	//Initialize queues
 	hp_q = queue_new();
-	lp_q = queue_new();
-	w_q = queue_new();
+
+	//Every thread starts in the default group 0
+	groups[0].in_use = 1;
+	groups[0].parent = -1;
+	groups[0].weight = GROUP_WEIGHT;
+	groups[0].quota = 0;
+	groups[0].q = queue_new();
+
+	//Every block keeps its context in t_env
+	for(i=0; i<N; i++){
+		t_state[i].run_env = &t_env[i];
+	}
+	idle.run_env = &idle_env;
 
 	/* Create context for the idle thread */
-	if(getcontext(&idle.run_env) == -1){
+	if(getcontext(idle.run_env) == -1){
 		perror("*** ERROR: getcontext in init_thread_lib");
 		exit(-1);
 	}
 	idle.state = IDLE;
 	idle.priority = SYSTEM;
 	idle.function = idle_function;
-	idle.run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
+	idle.run_env->uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
 	idle.tid = -1;
-	if(idle.run_env.uc_stack.ss_sp == NULL){
+	if(idle.run_env->uc_stack.ss_sp == NULL){
 		printf("*** ERROR: thread failed to get stack space\n");
 		exit(-1);
 	}
-	idle.run_env.uc_stack.ss_size = STACKSIZE;
-	idle.run_env.uc_stack.ss_flags = 0;
+	idle.run_env->uc_stack.ss_size = STACKSIZE;
+	idle.run_env->uc_stack.ss_flags = 0;
 	idle.ticks = QUANTUM_TICKS;
-	makecontext(&idle.run_env, idle_function, 1);
+	makecontext(idle.run_env, idle_function, 1);
 
 	t_state[0].state = INIT;
 	t_state[0].priority = LOW_PRIORITY;
-	t_state[0].ticks = QUANTUM_TICKS;
-	if(getcontext(&t_state[0].run_env) == -1){
+	t_state[0].quantum = QUANTUM_TICKS;
+	t_state[0].ticks = t_state[0].quantum;
+	t_state[0].stats.quantum = t_state[0].ticks;
+	if(getcontext(t_state[0].run_env) == -1){
 		perror("*** ERROR: getcontext in init_thread_lib");
 		exit(5);
 	}
@@ -79,9 +139,12 @@ void init_mythreadlib() {
 
 	for(i=1; i<N; i++){
 		t_state[i].state = FREE;
+		t_state[i].slab = NULL;
 	}
 
 	t_state[0].tid = 0;
+	t_state[0].group = 0;
+	t_state[0].slab = NULL;
 	running = &t_state[0];
 
 	/* Initialize network and clock interrupts */
@@ -90,111 +153,553 @@ void init_mythreadlib() {
 }
 
 
+/* Smallest vruntime among the groups with ready threads under parent, -1 if none */
+static long group_min_vruntime(int parent){
+	int g;
+	long min = -1;
+
+	for(g=0; g<MAX_GROUPS; g++){
+		if(groups[g].in_use && groups[g].parent == parent && groups[g].ready > 0
+				&& (min == -1 || groups[g].vruntime < min)){
+			min = groups[g].vruntime;
+		}
+	}
+	return min;
+}
+
+/* Insert a thread at the end of the ready queue of its priority */
+static void make_ready(TCB *t){
+	int g;
+	long min;
+
+	if(t->priority == HIGH_PRIORITY){
+		enqueue(hp_q, t);
+	}
+	else{
+		enqueue(groups[t->group].q, t);
+		lp_ready++;
+		for(g = t->group; g != -1; g = groups[g].parent){
+			//A group that was idle does not get credit for the time it did not run:
+			//it starts from the smallest vruntime of its ready siblings, before it counts as ready
+			if(groups[g].ready == 0){
+				min = group_min_vruntime(groups[g].parent);
+				if(groups[g].vruntime < min) groups[g].vruntime = min;
+			}
+			groups[g].ready++;
+		}
+	}
+}
+
+static int group_throttled(int g){
+	return groups[g].quota > 0 && groups[g].used >= groups[g].quota;
+}
+
+/* Pick the group whose queue runs next: descend from the top level choosing, at each
+level, the non throttled child with ready threads and the smallest vruntime. The own
+threads of a group run only when none of its children can. Returns -1 if none */
+static int group_pick(){
+	int g, best, node = -1;
+
+	while(1){
+		best = -1;
+		for(g=0; g<MAX_GROUPS; g++){
+			if(groups[g].in_use && groups[g].parent == node && groups[g].ready > 0 && !group_throttled(g)
+					&& (best == -1 || groups[g].vruntime < groups[best].vruntime)){
+				best = g;
+			}
+		}
+		if(best == -1){
+			return (node != -1 && queue_empty(groups[node].q) == 0) ? node : -1;
+		}
+		node = best;
+	}
+}
+
+/* Take the first thread of group g out of its queue */
+static TCB* group_dequeue(int g){
+	TCB *t = dequeue(groups[g].q);
+
+	lp_ready--;
+	for(; g != -1; g = groups[g].parent){
+		groups[g].ready--;
+	}
+	return t;
+}
+
+/* Charge one tick of t to its group and ancestors. Returns 1 if any of them ran out of quota */
+static int group_charge(TCB *t){
+	int g, throttled = 0;
+
+	for(g = t->group; g != -1; g = groups[g].parent){
+		groups[g].used++;
+		groups[g].stats.runtime++;
+		groups[g].vruntime += GROUP_WEIGHT * 16 / groups[g].weight;
+		if(group_throttled(g)){
+			if(groups[g].used == groups[g].quota) groups[g].stats.throttled++;
+			throttled = 1;
+		}
+	}
+	return throttled;
+}
+
+/* Start a new quota period */
+static void group_period(){
+	int g;
+
+	for(g=0; g<MAX_GROUPS; g++){
+		groups[g].used = 0;
+	}
+	period_ticks = 0;
+}
+
+static int quantum_clamp(int q){
+	if(q < q_min) return q_min;
+	if(q > q_max) return q_max;
+	return q;
+}
+
+/* Choose the next quantum of t. A thread that used its whole quantum is CPU bound
+and gets twice as long to cut switches, one that gave up the processor earlier gets
+half. The result is capped so that a full round of lp_q takes at most SCHED_LATENCY */
+static int next_quantum(TCB *t, int expired){
+	int q;
+
+	if(!q_adaptive){
+		t->stats.quantum = QUANTUM_TICKS;
+		return QUANTUM_TICKS;
+	}
+	t->quantum = quantum_clamp(expired ? t->quantum * 2 : t->quantum / 2);
+	q = t->quantum;
+	if(lp_ready > 0 && q > SCHED_LATENCY / (lp_ready + 1)){
+		q = quantum_clamp(SCHED_LATENCY / (lp_ready + 1));
+	}
+	t->stats.quantum = q;
+	return q;
+}
+
+/* Stack of the last exited thread, released once we are no longer running on it */
+static struct stack_slab *zombie = NULL;
+
+/* Release the stack left behind by an exited thread */
+static void reap_stack(){
+	if(zombie != NULL){
+		free(zombie);
+		zombie = NULL;
+	}
+}
+
+/* Entry point of every created thread */
+static void thread_start(){
+	//The context was made by a thread that had the clock interrupt disabled
+	enable_interrupt();
+	reap_stack();
+	if(running->routine != NULL){
+		running->routine(running->arg);
+	}
+	else{
+		running->function(running->tid);
+	}
+	mythread_exit();
+}
+
+/* Allocate one slab holding n stacks of size bytes each */
+static struct stack_slab* stack_alloc(int n, size_t size){
+	struct stack_slab *slab = malloc(STACK_HDR + (size_t) n * size);
+	if(slab == NULL){
+		printf("*** ERROR: thread failed to get stack space\n");
+		exit(-1);
+	}
+	slab->refs = n;
+	return slab;
+}
+
+/* Initialize the TCB in slot i from the context template env and make it ready */
+static void thread_setup(int i, const ucontext_t *env, int priority, void *stack, size_t size){
+	*t_state[i].run_env = *env;
+	t_state[i].state = INIT;
+	t_state[i].priority = priority;
+	t_state[i].tid = i;
+	t_state[i].run_env->uc_stack.ss_sp = stack;
+	t_state[i].run_env->uc_stack.ss_size = size;
+	t_state[i].run_env->uc_stack.ss_flags = 0;
+	t_state[i].run_env->uc_link = NULL;
+	t_state[i].quantum = quantum_clamp(QUANTUM_TICKS);
+	t_state[i].ticks = t_state[i].quantum;
+	memset(&t_state[i].stats, 0, sizeof(t_state[i].stats));
+	t_state[i].stats.quantum = t_state[i].ticks;
+
+	makecontext(t_state[i].run_env, thread_start, 0);
+
+	//Insert process into its corresponding queue
+	make_ready(&t_state[i]);
+
+	TRACE("*** THREAD %d READY\n", t_state[i].tid);
+}
+
+/* If low priority process is running and a high priority process arrives,
+we stop the low priority process execution to execute the high priority one.
+Called with the clock interrupt disabled */
+static void preempt_check(int priority){
+	if(running->priority == LOW_PRIORITY && priority == HIGH_PRIORITY) {
+		activator(scheduler());
+	}
+}
+
+/* Fill attr with the default thread attributes */
+void mythread_attr_init(mythread_attr_t *attr)
+{
+	if (!init) { init_mythreadlib(); init=1;}
+	attr->priority = LOW_PRIORITY;
+	attr->stacksize = STACKSIZE;
+	attr->group = running->group;
+}
+
 /* Create and intialize a new thread with body fun_addr and one integer argument */
 int mythread_create (void (*fun_addr)(),int priority)
 {
 	int i;
+	ucontext_t env;
 
 	if (!init) { init_mythreadlib(); init=1;}
+	disable_interrupt();
 	for (i=0; i<N; i++)
 		if (t_state[i].state == FREE) break;
-	if (i == N) return(-1);
-	if(getcontext(&t_state[i].run_env) == -1){
+	if (i == N){
+		enable_interrupt();
+		return(-1);
+	}
+	if(getcontext(&env) == -1){
 		perror("*** ERROR: getcontext in my_thread_create\n");
 		exit(-1);
 	}
-	t_state[i].state = INIT;
-	t_state[i].priority = priority;
 	t_state[i].function = fun_addr;
-	t_state[i].run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
-	if(t_state[i].run_env.uc_stack.ss_sp == NULL){
-		printf("*** ERROR: thread failed to get stack space\n");
-		exit(-1);
+	t_state[i].routine = NULL;
+	t_state[i].arg = NULL;
+	t_state[i].slab = stack_alloc(1, STACKSIZE);
+	t_state[i].group = running->group;
+	thread_setup(i, &env, priority, STACK_BASE(t_state[i].slab, 0, STACKSIZE), STACKSIZE);
+
+	preempt_check(priority);
+	enable_interrupt();
+
+	return i;
+} /****** End my_thread_create() ******/
+
+/* Create and intialize a new thread running fun_addr(arg) with the given attributes */
+int mythread_create_arg (void (*fun_addr)(void *), void *arg, const mythread_attr_t *attr)
+{
+	int tid;
+
+	if(mythread_create_batch(1, fun_addr, &arg, attr, &tid) == -1){
+		return -1;
 	}
-	t_state[i].tid = i;
-	t_state[i].run_env.uc_stack.ss_size = STACKSIZE;
-	t_state[i].run_env.uc_stack.ss_flags = 0;
-	t_state[i].ticks = QUANTUM_TICKS;
+	return tid;
+}
 
-	makecontext(&t_state[i].run_env, fun_addr, 1);
+/* Create n threads running fun_addr(args[k]) with a single TCB scan, stack allocation and
+preemption check. The new thread ids are stored in tids, if not NULL */
+int mythread_create_batch (int n, void (*fun_addr)(void *), void **args, const mythread_attr_t *attr, int *tids)
+{
+	int i, k;
+	mythread_attr_t def;
+	ucontext_t env;
+	struct stack_slab *slab;
+	size_t size;
 
-	//Insert process into its corresponding queue
-	if(t_state[i].priority == HIGH_PRIORITY){
-		enqueue(hp_q, &t_state[i]);
+	if (!init) { init_mythreadlib(); init=1;}
+	if(attr == NULL){
+		mythread_attr_init(&def);
+		attr = &def;
 	}
-	else{
-		enqueue(lp_q, &t_state[i]);
+	if(n <= 0 || n > N || attr->stacksize < MINSIGSTKSZ) return(-1);
+	if(attr->group < 0 || attr->group >= MAX_GROUPS || !groups[attr->group].in_use) return(-1);
+
+	//Check there are n free blocks before allocating anything
+	disable_interrupt();
+	for (i=0, k=0; i<N && k<n; i++)
+		if (t_state[i].state == FREE) k++;
+	if (k < n){
+		enable_interrupt();
+		return(-1);
 	}
 
-	printf("*** THREAD %d READY\n", t_state[i].tid);
-
-	/* If low priority process is running and a high priority process arrives,
-	we stop the low priority process execution to execute the high priority one*/
-	if(running->priority == LOW_PRIORITY && t_state[i].priority == HIGH_PRIORITY) {
-		disable_interrupt();
-		disable_network_interrupt();
-		activator(scheduler());
+	//One context template and one slab for the whole batch
+	if(getcontext(&env) == -1){
+		perror("*** ERROR: getcontext in my_thread_create\n");
+		exit(-1);
+	}
+	size = (attr->stacksize + 15) & ~((size_t) 15);
+	slab = stack_alloc(n, size);
+
+	for (i=0, k=0; k<n; i++){
+		if (t_state[i].state != FREE) continue;
+		t_state[i].function = NULL;
+		t_state[i].routine = fun_addr;
+		t_state[i].arg = args != NULL ? args[k] : NULL;
+		t_state[i].slab = slab;
+		t_state[i].group = attr->group;
+		thread_setup(i, &env, attr->priority, STACK_BASE(slab, k, size), size);
+		if(tids != NULL) tids[k] = i;
+		k++;
 	}
 
-	return i;
-} /****** End my_thread_create() ******/
+	preempt_check(attr->priority);
+	enable_interrupt();
+
+	return n;
+} /****** End my_thread_create_batch() ******/
+
+/* Push a woken thread. Lock-free and async-signal safe: a push interrupted by a handler
+that pushes too just retries the compare and swap */
+static void wake_push(TCB *t){
+	TCB *head = __atomic_load_n(&wake_head, __ATOMIC_RELAXED);
+
+	do{
+		t->wake_next = head;
+	}while(!__atomic_compare_exchange_n(&wake_head, &head, t, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* Move the woken threads to the ready queues, in the order they were woken.
+Called with the clock interrupt disabled or from its handler */
+static void wake_drain(){
+	TCB *t = __atomic_exchange_n(&wake_head, NULL, __ATOMIC_ACQUIRE), *fifo = NULL, *next;
+
+	if(t == NULL) return;
+	while(t != NULL){
+		next = t->wake_next;
+		t->wake_next = fifo;
+		fifo = t;
+		t = next;
+	}
+	for(t = fifo; t != NULL; t = next){
+		next = t->wake_next;
+		t->state = INIT;
+		make_ready(t);
+		TRACE("*** THREAD %d READY\n", t->tid);
+	}
+}
 
 /* Read network syscall */
 int read_network()
 {
+	if (!init) { init_mythreadlib(); init=1;}
+	disable_interrupt();
+
+	//Leave the processor until network_interrupt wakes us up
 	running->state = WAITING;
-	enqueue(w_q, running);
-	printf("*** THREAD %d READ FROM NETWORK\n", current);
+	wait_ring[wait_tail] = running;
+	__atomic_store_n(&wait_tail, wait_tail == N ? 0 : wait_tail + 1, __ATOMIC_RELEASE);
+	TRACE("*** THREAD %d READ FROM NETWORK\n", current);
 
-	if(running->priority == LOW_PRIORITY && running->ticks == 0){
-		running->ticks = QUANTUM_TICKS;
-		disable_interrupt();
-		disable_network_interrupt();
-		TCB* next = scheduler();
-		activator(next);
-	}
+	running->stats.yields++;
+	running->ticks = next_quantum(running, 0);
+	TCB* next = scheduler();
+	activator(next);
 
+	enable_interrupt();
 	return 1;
 }
 
-/* Network interrupt  */
+/* Network interrupt: wake up the oldest thread waiting for a packet */
 void network_interrupt(int sig)
 {
-	if(queue_empty(w_q) == 0){
-		TCB* d = dequeue(w_q);
-
-		d->state = INIT;
-		if (d->priority == HIGH_PRIORITY) {
-			enqueue(hp_q, d);
-		} else {
-			enqueue(lp_q, d);
-		}
+	unsigned int head = wait_head;
+
+	if(head != __atomic_load_n(&wait_tail, __ATOMIC_ACQUIRE)){
+		TCB* d = wait_ring[head];
+		__atomic_store_n(&wait_head, head == N ? 0 : head + 1, __ATOMIC_RELEASE);
+		wake_push(d);
+	}
+}
 
-		printf("*** THREAD %d READY\n", d->tid);
+
+/* Keys allocated so far and their destructors */
+static int nkeys = 0;
+static void (*key_destructor[MYTHREAD_KEYS])(void *);
+
+/* Allocate a new key. Returns 0 if correct or -1 if there are no keys left */
+int mythread_key_create(mythread_key_t *key, void (*destructor)(void *))
+{
+	if (!init) { init_mythreadlib(); init=1;}
+	mythread_preempt_disable();
+	if(nkeys == MYTHREAD_KEYS){
+		mythread_preempt_enable();
+		return -1;
 	}
+	key_destructor[nkeys] = destructor;
+	*key = nkeys++;
+	mythread_preempt_enable();
+	return 0;
 }
 
+/* Value of key for the calling thread, NULL if it was never set or key was not created */
+void* mythread_key_get(mythread_key_t key)
+{
+	if (!init) { init_mythreadlib(); init=1;}
+	if(key < 0 || key >= nkeys){
+		return NULL;
+	}
+	return running->tls[key];
+}
+
+/* Set the value of key for the calling thread. Returns 0 if correct or -1 if key was not created */
+int mythread_key_set(mythread_key_t key, void *value)
+{
+	if (!init) { init_mythreadlib(); init=1;}
+	if(key < 0 || key >= nkeys){
+		return -1;
+	}
+	running->tls[key] = value;
+	return 0;
+}
+
+/* Run the destructors of the non NULL values of an exiting thread. A destructor
+may set other keys, so this is repeated a bounded number of times */
+static void key_destroy(TCB *t){
+	int i, k, pending = 1;
+	void *value;
+
+	for(i=0; i<MYTHREAD_DESTRUCTOR_ITERATIONS && pending; i++){
+		pending = 0;
+		for(k=0; k<nkeys; k++){
+			if(t->tls[k] != NULL && key_destructor[k] != NULL){
+				value = t->tls[k];
+				t->tls[k] = NULL;
+				key_destructor[k](value);
+				pending = 1;
+			}
+		}
+	}
+	memset(t->tls, 0, sizeof(t->tls));
+}
 
 /* Free terminated thread and exits */
 void mythread_exit() {
 	int tid = mythread_gettid();
 
-	printf("*** THREAD %d FINISHED\n", tid);
+	TRACE("*** THREAD %d FINISHED\n", tid);
+	key_destroy(&t_state[tid]);
 	t_state[tid].state = FREE;
-	free(t_state[tid].run_env.uc_stack.ss_sp);
 
-	//If there are still processes in any queue, we select the next process to execute
-	if(queue_empty(hp_q) == 0 || queue_empty(lp_q) == 0){
+	//The stack can not be released while we are still running on it
+	reap_stack();
+	if(t_state[tid].slab != NULL && --t_state[tid].slab->refs == 0){
+		zombie = t_state[tid].slab;
+	}
+	t_state[tid].slab = NULL;
+
+	//If there are still processes ready or waiting for the network, we select the next process to execute
+	if(queue_empty(hp_q) == 0 || lp_ready > 0 || wait_head != wait_tail || wake_head != NULL){
 		disable_interrupt();
-		disable_network_interrupt();
 		TCB* next = scheduler();
 		activator(next);
 	}
 
-	printf("FINISH\n");
+	TRACE("FINISH\n");
 	exit(0);
 }
 
+/* Gives up the processor in favour of the next ready thread */
+void mythread_yield() {
+	if (!init) { init_mythreadlib(); init=1;}
+	disable_interrupt();
+	running->stats.yields++;
+	running->ticks = next_quantum(running, 0);
+	activator(scheduler());
+	enable_interrupt();
+}
+
+/* Defers preemption of the calling thread until mythread_preempt_enable */
+void mythread_preempt_disable() {
+	no_preempt++;
+}
+
+/* Ends a critical section, switching now if the quantum expired inside it. This is
+the preemption timer_interrupt deferred, which already counted it and set the next
+quantum, so it is not a yield */
+void mythread_preempt_enable() {
+	if(--no_preempt == 0 && preempt_pending){
+		disable_interrupt();
+		preempt_pending = 0;
+		activator(scheduler());
+		enable_interrupt();
+	}
+}
+
+/* Selects a fixed quantum (adaptive == 0) or an adaptive one between min and max ticks.
+Returns 0 if correct or -1 if the bounds are not valid */
+int mythread_setquantum(int adaptive, int min, int max) {
+	if (!init) { init_mythreadlib(); init=1;}
+	if(adaptive && (min < 1 || max < min)) return -1;
+	q_adaptive = adaptive;
+	q_min = adaptive ? min : QUANTUM_TICKS;
+	q_max = adaptive ? max : QUANTUM_TICKS;
+	running->quantum = quantum_clamp(running->quantum);
+	return 0;
+}
+
+/* Sets the weight and the quota (ticks per GROUP_PERIOD, 0 for unlimited) of a group */
+int mythread_group_set(int group, int weight, int quota) {
+	if(group < 0 || group >= MAX_GROUPS || !groups[group].in_use) return -1;
+	if(weight < 1 || weight > GROUP_WEIGHT * 16 || quota < 0) return -1;
+	groups[group].weight = weight;
+	groups[group].quota = quota;
+	return 0;
+}
+
+/* Creates a group under parent (-1 for top level). Returns its id or -1 on error */
+int mythread_group_create(int parent, int weight, int quota) {
+	int g;
+
+	if (!init) { init_mythreadlib(); init=1;}
+	if(parent < -1 || parent >= MAX_GROUPS || (parent != -1 && !groups[parent].in_use)) return -1;
+	for(g=0; g<MAX_GROUPS; g++)
+		if(!groups[g].in_use) break;
+	if(g == MAX_GROUPS) return -1;
+
+	groups[g].in_use = 1;
+	groups[g].parent = parent;
+	groups[g].used = groups[g].ready = 0;
+	groups[g].vruntime = 0;
+	memset(&groups[g].stats, 0, sizeof(groups[g].stats));
+	if(groups[g].q == NULL) groups[g].q = queue_new();
+	if(mythread_group_set(g, weight, quota) == -1){
+		groups[g].in_use = 0;
+		return -1;
+	}
+	return g;
+}
+
+/* Moves the calling thread to a group */
+int mythread_group_join(int group) {
+	if (!init) { init_mythreadlib(); init=1;}
+	if(group < 0 || group >= MAX_GROUPS || !groups[group].in_use) return -1;
+	running->group = group;
+	return 0;
+}
+
+/* Copies the accounting of a group into st */
+int mythread_group_getstats(int group, mythread_group_stats_t *st) {
+	if(group < 0 || group >= MAX_GROUPS || !groups[group].in_use) return -1;
+	*st = groups[group].stats;
+	return 0;
+}
+
+/* Copies the statistics of thread tid into st. Returns 0 if correct or -1 if tid is not valid */
+int mythread_getstats(int tid, mythread_stats_t *st) {
+	if(tid < 0 || tid >= N || t_state[tid].state == FREE) return -1;
+	*st = t_state[tid].stats;
+	return 0;
+}
+
+/* Stack of thread tid. Returns 0 if correct or -1 if it is unknown, as for the main thread */
+int mythread_getstack(int tid, void **base, size_t *size) {
+	if(tid < 0 || tid >= N || t_state[tid].state == FREE || t_state[tid].slab == NULL) return -1;
+	*base = t_state[tid].run_env->uc_stack.ss_sp;
+	*size = t_state[tid].run_env->uc_stack.ss_size;
+	return 0;
+}
+
 /* Sets the priority of the calling thread */
 void mythread_setpriority(int priority) {
 	int tid = mythread_gettid();
@@ -218,22 +723,22 @@ int mythread_gettid(){
 /* FIFO para alta prioridad, RR para baja*/
 TCB* scheduler(){
 
+	int g;
+
 	//If running process has not ended, we insert it at the end of the corresponding queue
-	if(running->state != FREE){
-		if(running->priority == HIGH_PRIORITY){
-			enqueue(hp_q, running);
-		}
-		else{
-			enqueue(lp_q, running);
-		}
+	if(running->state == INIT){
+		make_ready(running);
 	}
+	//Then the threads woken since the last decision. This may include running itself,
+	//if it started waiting and the packet arrived before we left it
+	wake_drain();
 
 	if(queue_empty(hp_q) == 0){
 		return dequeue(hp_q);
 	}
 	else{
-		if(queue_empty(lp_q) == 0){
-			return dequeue(lp_q);
+		if((g = group_pick()) != -1){
+			return group_dequeue(g);
 		}
 		else{
 			return &idle;
@@ -244,12 +749,39 @@ TCB* scheduler(){
 /* Timer interrupt  */
 void timer_interrupt(int sig)
 {
+	int throttled = 0;
+
+	if(++period_ticks == GROUP_PERIOD){
+		group_period();
+	}
+	wake_drain();
+
+	//Leave the idle thread as soon as a thread can run
+	if(running->state == IDLE){
+		if(queue_empty(hp_q) == 0 || group_pick() != -1){
+			disable_interrupt();
+			activator(scheduler());
+		}
+		return;
+	}
+
 	//Reduce ticks remaining to finish the process in each clock interrupt
 	running->ticks--;
+	running->stats.ticks++;
+	throttled = group_charge(running);
+
+	//Reset quantum ticks to low priority porcesses, or stop them if their group is out of quota
+	if(running->priority == LOW_PRIORITY && (running->ticks <= 0 || throttled)){
+		if(running->ticks <= 0){
+			running->stats.preemptions++;
+			running->ticks = next_quantum(running, 1);
+		}
 
-	//Reset quantum ticks to low priority porcesses
-	if(running->priority == LOW_PRIORITY && running->ticks == 0){
-		running->ticks = QUANTUM_TICKS;
+		//Inside a critical section the switch is done by mythread_preempt_enable
+		if(no_preempt > 0){
+			preempt_pending = 1;
+			return;
+		}
 		disable_interrupt();
 		TCB* next = scheduler();
 		activator(next);
@@ -261,42 +793,37 @@ void activator(TCB* next){
 
 	TCB * temp = running;
 
+	//Interrupts stay disabled: the context we switch to restores its own signal mask
 	//Update process tid
 	current = next->tid;
 	running = next;
 
 	if (temp->tid != next->tid && running->state != FREE) {
 		if(temp->state == FREE){
-			printf("*** THREAD %d FINISHED: SET CONTEXT OF %d \n", temp->tid, next->tid);
-			if(next->priority == LOW_PRIORITY){
-				enable_interrupt();
-				enable_network_interrupt();
-			}
-			setcontext (&(next->run_env));
+			TRACE("*** THREAD %d FINISHED: SET CONTEXT OF %d \n", temp->tid, next->tid);
+			setcontext (next->run_env);
 			printf("mythread_free: After setcontext, should never get here!!...\n");
 		}
 		else{
 			//Swap from low priority process to high priority one
 			if(running->priority == HIGH_PRIORITY && temp->priority == LOW_PRIORITY){
-				printf("*** THREAD %d PREEMPTED: SET CONTEXT OF %d\n", temp->tid, running->tid);
+				TRACE("*** THREAD %d PREEMPTED: SET CONTEXT OF %d\n", temp->tid, running->tid);
 
-				swapcontext(&(temp->run_env),&(running->run_env));
+				swapcontext(temp->run_env,running->run_env);
+				reap_stack();
 			}
 				//Standard not finished process
 			else{
 				if(temp->tid != next->tid){	//Avoid context swaping of same process
 					if(temp->state == IDLE){
-						printf("*** THREAD READY: SET CONTEXT TO %d\n", next->tid);
+						TRACE("*** THREAD READY: SET CONTEXT TO %d\n", next->tid);
 					}
 					else{
-						printf("*** SWAPCONTEXT FROM %d TO %d\n", temp->tid, next->tid);
+						TRACE("*** SWAPCONTEXT FROM %d TO %d\n", temp->tid, next->tid);
 					}
 
-					if(next->priority == LOW_PRIORITY){
-						enable_interrupt();
-						enable_network_interrupt();
-					}
-					swapcontext(&(temp->run_env),&(next->run_env));
+					swapcontext(temp->run_env,next->run_env);
+					reap_stack();
 				}
 			}
 		}
@@ -0,0 +1,156 @@
+/* Cost of a scheduling decision as the number of threads grows.
+Each round creates T workers that yield K times; every yield is one pass through
+scheduler() and activator(). Cache misses are read from the hardware counters when
+perf_event_open is available. The same is then measured for stackless coroutines,
+up to a million of them.
+Build with: make bench_sched */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "mythread.h"
+#include "coroutine.h"
+
+#define YIELDS 200
+
+static const int rounds[] = {16, 256, 1024, 4000};
+static const int coro_rounds[] = {16, 1024, 65536, 1000000};
+static volatile long decisions = 0;
+static volatile int finished = 0;
+
+/* Open a user space hardware counter, -1 if not available */
+static int counter_open(unsigned int type, unsigned long long config){
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long counter_read(int fd){
+	long long value = 0;
+
+	if(fd == -1 || read(fd, &value, sizeof(value)) != sizeof(value)) return -1;
+	return value;
+}
+
+static void worker(void *arg){
+	int k;
+
+	for(k=0; k<YIELDS; k++){
+		decisions++;
+		mythread_yield();
+	}
+	finished++;
+}
+
+/* Coroutine frame of the benchmark */
+struct yielder{
+	coro_t co;
+	int k;
+};
+
+static int yielder_body(coro_t *co){
+	struct yielder *y = (struct yielder *) co;
+
+	CORO_BEGIN(co);
+	for(y->k=0; y->k<YIELDS; y->k++){
+		decisions++;
+		CORO_YIELD(co);
+	}
+	finished++;
+	CORO_END(co);
+}
+
+static void bench_coroutines(){
+	struct timespec start, end;
+	struct yielder *frames;
+	double ns;
+	int r, i, t;
+
+	printf("sizeof(coro_t) = %zu bytes, frame = %zu bytes\n", sizeof(coro_t), sizeof(struct yielder));
+	printf("%10s %12s %14s %12s\n", "coroutines", "switches", "ns/switch", "frames MB");
+
+	for(r=0; r<sizeof(coro_rounds)/sizeof(coro_rounds[0]); r++){
+		t = coro_rounds[r];
+		if((frames = malloc(sizeof(struct yielder) * t)) == NULL){
+			printf("*** ERROR: could not allocate %d coroutines\n", t);
+			return;
+		}
+		decisions = 0;
+		finished = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(i=0; i<t; i++){
+			if(coro_spawn(&frames[i].co, yielder_body, LOW_PRIORITY) == -1){
+				printf("*** ERROR: could not start the coroutines\n");
+				return;
+			}
+		}
+		while(finished < t){
+			mythread_yield();
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+		printf("%10d %12ld %14.1f %12.1f\n", t, decisions, ns / decisions, sizeof(struct yielder) * (double) t / (1 << 20));
+		free(frames);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec start, end;
+	mythread_attr_t attr;
+	long long l1, llc;
+	double ns;
+	int r, t, fd_l1, fd_llc;
+
+	fd_l1 = counter_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+			(PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	fd_llc = counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+	mythread_attr_init(&attr);
+	printf("sizeof(TCB) = %zu bytes, sizeof(ucontext_t) = %zu bytes, N = %d\n", sizeof(TCB), sizeof(ucontext_t), N);
+	printf("%8s %12s %14s %16s %16s\n", "threads", "decisions", "ns/decision", "L1D miss/dec", "LLC miss/dec");
+
+	for(r=0; r<sizeof(rounds)/sizeof(rounds[0]); r++){
+		t = rounds[r] < N ? rounds[r] : N - 1;
+		decisions = 0;
+		finished = 0;
+		if(mythread_create_batch(t, worker, NULL, &attr, NULL) == -1){
+			printf("*** ERROR: could not create %d threads\n", t);
+			return -1;
+		}
+
+		if(fd_l1 != -1) ioctl(fd_l1, PERF_EVENT_IOC_RESET, 0);
+		if(fd_llc != -1) ioctl(fd_llc, PERF_EVENT_IOC_RESET, 0);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		while(finished < t){
+			decisions++;
+			mythread_yield();
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		l1 = counter_read(fd_l1);
+		llc = counter_read(fd_llc);
+
+		ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+		printf("%8d %12ld %14.1f", t, decisions, ns / decisions);
+		if(l1 >= 0) printf(" %16.2f", (double) l1 / decisions); else printf(" %16s", "n/a");
+		if(llc >= 0) printf(" %16.2f\n", (double) llc / decisions); else printf(" %16s\n", "n/a");
+	}
+
+	bench_coroutines();
+	mythread_exit();
+	return 0;
+}
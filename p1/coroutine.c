@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mythread.h"
+#include "coroutine.h"
+
+/* Thread running the coroutines of one priority */
+struct carrier{
+	int alive; /* 1 while the carrier thread exists */
+	coro_t *head, *tail; /* coroutines ready to run */
+	coro_t *whead, *wtail; /* coroutines waiting for the network, oldest first */
+};
+
+static struct carrier carriers[2]; /* indexed by priority */
+
+static void coro_push(coro_t **head, coro_t **tail, coro_t *co){
+	co->next = NULL;
+	if(*tail == NULL){
+		*head = *tail = co;
+	}
+	else{
+		(*tail)->next = co;
+		*tail = co;
+	}
+}
+
+static coro_t* coro_pop(coro_t **head, coro_t **tail){
+	coro_t *co = *head;
+
+	if(co != NULL){
+		*head = co->next;
+		if(*head == NULL) *tail = NULL;
+	}
+	return co;
+}
+
+/* Body of the carrier threads: resume the ready coroutines in turn. When only waiting
+ones are left, the carrier waits for the network in their place and the packet goes
+to the oldest of them. The thread ends when it has no coroutines */
+static void carrier_run(void *arg){
+	struct carrier *k = arg;
+	coro_t *co;
+
+	while(1){
+		mythread_preempt_disable();
+		co = coro_pop(&k->head, &k->tail);
+		if(co == NULL && k->whead == NULL){
+			//A coroutine spawned from now on starts a new carrier
+			k->alive = 0;
+			mythread_preempt_enable();
+			return;
+		}
+		mythread_preempt_enable();
+
+		if(co == NULL){
+			read_network();
+			co = coro_pop(&k->whead, &k->wtail);
+			co->status = CORO_READY;
+		}
+
+		switch(co->body(co)){
+		case CORO_RUN:
+			mythread_preempt_disable();
+			coro_push(&k->head, &k->tail, co);
+			mythread_preempt_enable();
+			break;
+		case CORO_NET:
+			co->status = CORO_WAITING;
+			coro_push(&k->whead, &k->wtail, co);
+			break;
+		default:
+			co->status = CORO_DONE;
+		}
+	}
+}
+
+int coro_spawn(coro_t *co, int (*body)(coro_t *), int priority)
+{
+	struct carrier *k = &carriers[priority == HIGH_PRIORITY];
+	mythread_attr_t attr;
+	coro_t **p;
+	int start;
+
+	co->line = 0;
+	co->status = CORO_READY;
+	co->body = body;
+
+	mythread_preempt_disable();
+	coro_push(&k->head, &k->tail, co);
+	start = !k->alive;
+	k->alive = 1;
+	mythread_preempt_enable();
+
+	//The carrier is created out of the critical section, as it may preempt us
+	if(start){
+		mythread_attr_init(&attr);
+		attr.priority = priority == HIGH_PRIORITY ? HIGH_PRIORITY : LOW_PRIORITY;
+		if(mythread_create_arg(carrier_run, k, &attr) == -1){
+			mythread_preempt_disable();
+			k->alive = 0;
+			for(p = &k->head; *p != co; p = &(*p)->next);
+			*p = co->next;
+			if(k->tail == co){
+				for(k->tail = k->head; k->tail != NULL && k->tail->next != NULL; k->tail = k->tail->next);
+			}
+			mythread_preempt_enable();
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int coro_done(coro_t *co)
+{
+	return co->status == CORO_DONE;
+}
@@ -0,0 +1,59 @@
+#ifndef _COROUTINE_H_
+#define _COROUTINE_H_
+
+#include "mythread.h"
+
+/* Stackless coroutines. A coroutine is a frame owned by the caller, which starts
+with a coro_t, and a body that is called again every time the coroutine resumes.
+The body keeps its state in the frame: locals do not survive CORO_YIELD or
+CORO_READ_NETWORK, and two of them can not be on the same line.
+
+	struct echo{
+		coro_t co;
+		int i;
+	};
+
+	static int echo_body(coro_t *co){
+		struct echo *e = (struct echo *) co;
+
+		CORO_BEGIN(co);
+		for(e->i=0; e->i<10; e->i++){
+			CORO_READ_NETWORK(co);
+			CORO_YIELD(co);
+		}
+		CORO_END(co);
+	}
+
+Coroutines of each priority run inside one carrier mythread of that priority, so they
+share the processor with the threads through the same run queues. A switch between
+coroutines is a return and a call, without swapcontext */
+
+/* Values returned by a body, through the macros */
+#define CORO_RUN 0 /* ready to run again */
+#define CORO_NET 1 /* waiting for the network */
+#define CORO_EXIT 2 /* finished */
+
+/* Status of a coroutine */
+#define CORO_READY 0
+#define CORO_WAITING 1
+#define CORO_DONE 2
+
+typedef struct coro{
+	int line; /* where the body resumes, 0 at the start */
+	int status; /* CORO_READY, CORO_WAITING or CORO_DONE */
+	int (*body)(struct coro *); /* the code of the coroutine */
+	struct coro *next; /* next coroutine in the queue of its carrier */
+}coro_t;
+
+#define CORO_BEGIN(co) switch((co)->line){ case 0:
+#define CORO_YIELD(co) do{ (co)->line = __LINE__; return CORO_RUN; case __LINE__:; }while(0)
+#define CORO_READ_NETWORK(co) do{ (co)->line = __LINE__; return CORO_NET; case __LINE__:; }while(0)
+#define CORO_END(co) } return CORO_EXIT
+
+/* Start co running body with LOW_PRIORITY or HIGH_PRIORITY. Returns 0 if correct
+or -1 if the carrier thread can not be created */
+int coro_spawn(coro_t *co, int (*body)(coro_t *), int priority);
+/* Return 1 if the coroutine has finished and 0 otherwise */
+int coro_done(coro_t *co);
+
+#endif
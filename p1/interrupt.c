@@ -6,7 +6,14 @@
 #include <unistd.h>
 #include <interrupt.h>
 
-static sigset_t maskval_interrupt,oldmask_interrupt;
+static sigset_t maskval_interrupt;
+
+/* Called on every clock tick with the interrupted context, before the scheduler */
+static void (*tick_hook)(void *ctx) = NULL;
+
+void set_tick_hook(void (*hook)(void *ctx)){
+	tick_hook = hook;
+}
 
 
 void reset_timer(long usec) {
@@ -25,18 +32,22 @@ void reset_timer(long usec) {
 	}
 }
 
+/* Each call unblocks only its own signal: restoring a saved mask would also restore
+the other interrupt to the state it had when the two were disabled */
 void enable_interrupt(){
-	sigprocmask(SIG_SETMASK, &oldmask_interrupt, NULL);
+	sigaddset(&maskval_interrupt, SIGVTALRM);
+	sigprocmask(SIG_UNBLOCK, &maskval_interrupt, NULL);
 }
 
 void disable_interrupt(){
 	sigaddset(&maskval_interrupt, SIGVTALRM);
-	sigprocmask(SIG_BLOCK, &maskval_interrupt, &oldmask_interrupt);
+	sigprocmask(SIG_BLOCK, &maskval_interrupt, NULL);
 }
 
-void my_handler ()
+void my_handler (int sig, siginfo_t *info, void *ctx)
 {
 	reset_timer(TICK_TIME) ;
+	if(tick_hook != NULL) tick_hook(ctx);
 	timer_interrupt() ;
 }
 
@@ -48,9 +59,9 @@ void init_interrupt()
 	/* Initializes the signal mask to empty */
 	sigemptyset(&maskval_interrupt);
 	/* Prepare a virtual time alarm */
-	sigdat.sa_handler = my_handler;
+	sigdat.sa_sigaction = my_handler;
 	sigemptyset(&sigdat.sa_mask);
-	sigdat.sa_flags = SA_RESTART;
+	sigdat.sa_flags = SA_RESTART | SA_SIGINFO;
 	if(sigaction(SIGVTALRM, &sigdat, (struct sigaction *)0) == -1){
 		perror("signal set error");
 		exit(2);
@@ -58,7 +69,7 @@ void init_interrupt()
 	reset_timer(TICK_TIME) ;
 }
 
-static sigset_t maskval_net_interrupt,oldmask_net_interrupt;
+static sigset_t maskval_net_interrupt;
 
 void reset_network_timer(long usec) {
 	struct itimerval quantum;
@@ -77,12 +88,13 @@ void reset_network_timer(long usec) {
 }
 
 void enable_network_interrupt(){
-	sigprocmask(SIG_SETMASK, &oldmask_net_interrupt, NULL);
+	sigaddset(&maskval_net_interrupt, SIGPROF);
+	sigprocmask(SIG_UNBLOCK, &maskval_net_interrupt, NULL);
 }
 
 void disable_network_interrupt(){
 	sigaddset(&maskval_net_interrupt, SIGPROF);
-	sigprocmask(SIG_BLOCK, &maskval_net_interrupt, &oldmask_net_interrupt);
+	sigprocmask(SIG_BLOCK, &maskval_net_interrupt, NULL);
 }
 
 void my_network_handler ()
@@ -92,22 +104,42 @@ void my_network_handler ()
 }
 
 
+/* Period of the network interrupt and its timer, armed by init_network_interrupt */
+static long network_period = NET_TIME;
+static timer_t network_timer;
+static int network_armed = 0;
+
+static void arm_network_timer(){
+	struct itimerspec timerdata;
+
+	timerdata.it_interval.tv_sec = network_period / 1000000;
+	timerdata.it_interval.tv_nsec = (network_period % 1000000) * 1000;
+	timerdata.it_value = timerdata.it_interval;
+	timer_settime (network_timer, 0, &timerdata, NULL);
+}
+
+/* Change the period of the network interrupt. Can be called before or after init */
+void set_network_period(long usec)
+{
+	if(usec <= 0){
+		printf("*** ERROR: network period must be positive\n");
+		return;
+	}
+	network_period = usec;
+	if(network_armed){
+		arm_network_timer();
+	}
+}
+
 void init_network_interrupt()
 {
 	void network_interrupt(int sig);
 	struct sigevent event;
-	timer_t timer_id;
-	struct timespec periodTime;
-	struct itimerspec timerdata;
 	struct sigaction sigdat;
 	/* Create timer */
 	event.sigev_notify = SIGEV_SIGNAL;
 	event.sigev_signo = SIGPROF;
-	timer_create (CLOCK_REALTIME, &event, &timer_id);
-
-	// set periodTime time
-	periodTime.tv_sec=1;
-	periodTime.tv_nsec=0;
+	timer_create (CLOCK_REALTIME, &event, &network_timer);
 
 	/* Initializes the signal mask to empty */
 	sigemptyset(&maskval_net_interrupt);
@@ -118,9 +150,8 @@ void init_network_interrupt()
 	sigdat.sa_flags = SA_RESTART;
 
 	/* Arm periodic timer */
-	timerdata.it_interval = periodTime;
-	timerdata.it_value = periodTime;
-	timer_settime (timer_id, 0, &timerdata, NULL);
+	arm_network_timer();
+	network_armed = 1;
 
 	if(sigaction(SIGPROF, &sigdat, (struct sigaction *)0) == -1){
 		perror("signal set error");
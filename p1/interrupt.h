@@ -12,14 +12,17 @@
 
 #define TICK_TIME 5000
 #define PACK_TIME 1
+#define NET_TIME 1000000	/* default period of the network interrupt, in microseconds */
 #define STARVATION 200
 
 void timer_interrupt ();
 void init_interrupt();
 void disable_interrupt();
 void enable_interrupt();
+void set_tick_hook(void (*hook)(void *ctx));
 
 void network_interrupt ();
 void init_network_interrupt();
+void set_network_period(long usec);
 void disable_network_interrupt();
 void enable_network_interrupt();
@@ -1,3 +1,6 @@
+#ifndef _MYTHREAD_H_
+#define _MYTHREAD_H_
+
 #include <stdio.h>
 #include <sys/time.h>
 #include <signal.h>
@@ -7,31 +10,112 @@
 
 #include "interrupt.h"
 
+#ifndef N
 #define N 10
+#endif
 #define FREE 0
 #define INIT 1
 #define WAITING 2
 #define IDLE 3
 
-#define STACKSIZE 10000
+#ifndef STACKSIZE
+#define STACKSIZE 16384
+#endif
 #define QUANTUM_TICKS 40
+#define SCHED_LATENCY 400 /* ticks for a full round of lp_q with adaptive quantum */
+#ifndef MYTHREAD_KEYS
+#define MYTHREAD_KEYS 16
+#endif
+#define MYTHREAD_DESTRUCTOR_ITERATIONS 4
+
+#ifndef MAX_GROUPS
+#define MAX_GROUPS 8
+#endif
+#define GROUP_PERIOD 20 /* ticks of a quota period */
+#define GROUP_WEIGHT 1024 /* weight of the default group */
+
+/* Scheduler trace messages, left out when compiled with -DMYTHREAD_QUIET */
+#ifdef MYTHREAD_QUIET
+#define TRACE(...)
+#else
+#define TRACE(...) printf(__VA_ARGS__)
+#endif
 
 #define LOW_PRIORITY 0
 #define HIGH_PRIORITY 1
 #define SYSTEM 2
-/* Structure containing thread state  */
+
+/* Stack shared by one or more threads, released when the last one exits */
+struct stack_slab{
+	int refs; /* threads still running on this slab */
+};
+
+/* Scheduling statistics of a thread */
+typedef struct mythread_stats{
+	int quantum; /* last quantum granted, in ticks */
+	long ticks; /* ticks spent running */
+	long preemptions; /* quanta fully used */
+	long yields; /* voluntary releases of the processor */
+}mythread_stats_t;
+
+/* Accounting of a thread group */
+typedef struct mythread_group_stats{
+	long runtime; /* ticks run by the threads of the group and its descendants */
+	long throttled; /* periods in which the group ran out of quota */
+}mythread_group_stats_t;
+
+#define CACHE_LINE 64
+
+/* Structure containing thread state. The fields used by the scheduler fill the
+first cache line; the saved context is kept in a separate array (see run_env) */
 typedef struct tcb{
 	int state; /* the state of the current block: FREE or INIT */
 	int tid; /* thread id*/
 	int priority; /* thread priority*/
 	int ticks;
+	int group; /* thread group */
+	int quantum; /* quantum learnt by the adaptive mode */
+	ucontext_t *run_env; /* Context of the running environment*/
+	struct tcb *wake_next; /* next thread woken by an interrupt, see wake_push */
 	void (*function)(int);  /* the code of the thread */
-	ucontext_t run_env; /* Context of the running environment*/
-}TCB;
+	void (*routine)(void *); /* the code of a thread created with an argument */
+	void *arg; /* argument passed to routine */
+	struct stack_slab *slab; /* owner of the stack, NULL if not allocated by the library */
+	mythread_stats_t stats;
+	void *tls[MYTHREAD_KEYS]; /* thread local values, indexed by key */
+}__attribute__((aligned(CACHE_LINE))) TCB;
+
+/* Attributes of a new thread */
+typedef struct mythread_attr{
+	int priority; /* LOW_PRIORITY or HIGH_PRIORITY */
+	size_t stacksize; /* stack size in bytes */
+	int group; /* thread group */
+}mythread_attr_t;
+
+/* Thread local storage key: index of a slot in every TCB */
+typedef int mythread_key_t;
 
 int mythread_create (void (*fun_addr)(), int priority); /* Creates a new thread with one argument */
+void mythread_attr_init(mythread_attr_t *attr); /* Fills attr with the default attributes */
+int mythread_create_arg (void (*fun_addr)(void *), void *arg, const mythread_attr_t *attr); /* Creates a new thread receiving arg */
+int mythread_create_batch (int n, void (*fun_addr)(void *), void **args, const mythread_attr_t *attr, int *tids); /* Creates n threads at once */
 void mythread_setpriority(int priority); /* Sets the thread priority */
 int mythread_getpriority(); /* Returns the priority of calling thread*/
 void mythread_exit(); /* Frees the thread structure and exits the thread */
 int mythread_gettid(); /* Returns the thread id */
 int read_network(); /* */
+int mythread_key_create(mythread_key_t *key, void (*destructor)(void *)); /* Allocates a thread local storage key */
+void* mythread_key_get(mythread_key_t key); /* Returns the value of key for the calling thread */
+int mythread_key_set(mythread_key_t key, void *value); /* Sets the value of key for the calling thread */
+int mythread_setquantum(int adaptive, int min, int max); /* Selects fixed or adaptive quantum */
+int mythread_getstats(int tid, mythread_stats_t *st); /* Returns the scheduling statistics of a thread */
+int mythread_group_create(int parent, int weight, int quota); /* Creates a thread group */
+int mythread_group_set(int group, int weight, int quota); /* Changes the share and quota of a group */
+int mythread_group_join(int group); /* Moves the calling thread to a group */
+int mythread_group_getstats(int group, mythread_group_stats_t *st); /* Returns the accounting of a group */
+int mythread_getstack(int tid, void **base, size_t *size); /* Returns the stack of a thread */
+void mythread_yield(); /* Gives up the processor to the next ready thread */
+void mythread_preempt_disable(); /* Starts a section where the caller is not preempted */
+void mythread_preempt_enable(); /* Ends the section started by mythread_preempt_disable */
+
+#endif
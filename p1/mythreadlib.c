@@ -17,6 +17,8 @@ void network_interrupt(int sig);
 
 /* Array of state thread control blocks: the process allows a maximum of N threads */
 static TCB t_state[N];
+/* Saved contexts, apart from t_state so that scanning it does not walk over them */
+static ucontext_t t_env[N];
 
 /* Current running thread */
 static TCB* running;
@@ -27,6 +29,7 @@ static int init=0;
 
 /* Thread control block for the idle thread */
 static TCB idle;
+static ucontext_t idle_env;
 static void idle_function(){
   while(1);
 }
@@ -34,29 +37,35 @@ static void idle_function(){
 /* Initialize the thread library */
 void init_mythreadlib() {
 	int i;
+	//Every block keeps its context in t_env
+	for(i=0; i<N; i++){
+		t_state[i].run_env = &t_env[i];
+	}
+	idle.run_env = &idle_env;
+
 	/* Create context for the idle thread */
-	if(getcontext(&idle.run_env) == -1){
+	if(getcontext(idle.run_env) == -1){
 		perror("*** ERROR: getcontext in init_thread_lib");
 		exit(-1);
 	}
 	idle.state = IDLE;
 	idle.priority = SYSTEM;
 	idle.function = idle_function;
-	idle.run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
+	idle.run_env->uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
 	idle.tid = -1;
-	if(idle.run_env.uc_stack.ss_sp == NULL){
+	if(idle.run_env->uc_stack.ss_sp == NULL){
 		printf("*** ERROR: thread failed to get stack space\n");
 		exit(-1);
 	}
-	idle.run_env.uc_stack.ss_size = STACKSIZE;
-	idle.run_env.uc_stack.ss_flags = 0;
+	idle.run_env->uc_stack.ss_size = STACKSIZE;
+	idle.run_env->uc_stack.ss_flags = 0;
 	idle.ticks = QUANTUM_TICKS;
-	makecontext(&idle.run_env, idle_function, 1);
+	makecontext(idle.run_env, idle_function, 1);
 
 	t_state[0].state = INIT;
 	t_state[0].priority = LOW_PRIORITY;
 	t_state[0].ticks = QUANTUM_TICKS;
-	if(getcontext(&t_state[0].run_env) == -1){
+	if(getcontext(t_state[0].run_env) == -1){
 		perror("*** ERROR: getcontext in init_thread_lib");
 		exit(5);
 	}
@@ -83,22 +92,22 @@ int mythread_create (void (*fun_addr)(),int priority)
 	for (i=0; i<N; i++)
 		if (t_state[i].state == FREE) break;
 	if (i == N) return(-1);
-	if(getcontext(&t_state[i].run_env) == -1){
+	if(getcontext(t_state[i].run_env) == -1){
 		perror("*** ERROR: getcontext in my_thread_create");
 		exit(-1);
 	}
 	t_state[i].state = INIT;
 	t_state[i].priority = priority;
 	t_state[i].function = fun_addr;
-	t_state[i].run_env.uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
-	if(t_state[i].run_env.uc_stack.ss_sp == NULL){
+	t_state[i].run_env->uc_stack.ss_sp = (void *)(malloc(STACKSIZE));
+	if(t_state[i].run_env->uc_stack.ss_sp == NULL){
 		printf("*** ERROR: thread failed to get stack space\n");
 		exit(-1);
 	}
 	t_state[i].tid = i;
-	t_state[i].run_env.uc_stack.ss_size = STACKSIZE;
-	t_state[i].run_env.uc_stack.ss_flags = 0;
-	makecontext(&t_state[i].run_env, fun_addr, 1);
+	t_state[i].run_env->uc_stack.ss_size = STACKSIZE;
+	t_state[i].run_env->uc_stack.ss_flags = 0;
+	makecontext(t_state[i].run_env, fun_addr, 1);
 	return i;
 } /****** End my_thread_create() ******/
 
@@ -118,9 +127,9 @@ void network_interrupt(int sig)
 void mythread_exit() {
 	int tid = mythread_gettid();
 
-	printf("*** THREAD %d FINISHED\n", tid);
+	TRACE("*** THREAD %d FINISHED\n", tid);
 	t_state[tid].state = FREE;
-	free(t_state[tid].run_env.uc_stack.ss_sp);
+	free(t_state[tid].run_env->uc_stack.ss_sp);
 
 	TCB* next = scheduler();
 	activator(next);
@@ -167,6 +176,6 @@ void timer_interrupt(int sig)
 
 /* Activator */
 void activator(TCB* next){
-	setcontext (&(next->run_env));
+	setcontext (next->run_env);
 	printf("mythread_free: After setcontext, should never get here!!...\n");
 }
@@ -0,0 +1,150 @@
+/* Symbolise a profile written by prof_dump into folded stacks, one line per
+distinct stack with its sample count, as read by flame graph tools:
+	thread_1;main;fun1;busy 42
+Usage: ./prof_report <profile> */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "profiler.h"
+
+#define LINE_SIZE 4096
+
+struct sample{
+	int tid;
+	int depth;
+	unsigned long pc[PROF_MAX_DEPTH + 1];
+};
+
+/* Address looked up by addr2line and the name it resolved to */
+struct symbol{
+	unsigned long addr;
+	char name[256];
+};
+
+static int cmp_addr(const void *a, const void *b){
+	unsigned long x = *(const unsigned long *) a, y = *(const unsigned long *) b;
+	return x < y ? -1 : x > y;
+}
+
+static int cmp_symbol(const void *a, const void *b){
+	return cmp_addr(&((const struct symbol *) a)->addr, &((const struct symbol *) b)->addr);
+}
+
+static int cmp_string(const void *a, const void *b){
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Return addresses point after the call, so they are looked up one byte earlier */
+static unsigned long lookup_addr(struct sample *s, int j){
+	return j == 0 ? s->pc[j] : s->pc[j] - 1;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *f, *p;
+	char line[LINE_SIZE], exe[LINE_SIZE], cmd[2 * LINE_SIZE], tmp[] = "/tmp/prof_XXXXXX";
+	char *tok, **stacks;
+	unsigned long base, *addrs;
+	long dropped;
+	struct sample *samples = NULL;
+	struct symbol *syms, key, *sym;
+	int n = 0, cap = 0, naddrs = 0, nsyms = 0, i, j, fd;
+
+	if(argc != 2){
+		printf("Syntax: ./prof_report <profile>\n");
+		return -1;
+	}
+	if((f = fopen(argv[1], "r")) == NULL){
+		perror("*** ERROR: opening profile");
+		return -1;
+	}
+	if(fscanf(f, "exe %4095s\nbase %lx\ndropped %ld\n", exe, &base, &dropped) != 3){
+		printf("*** ERROR: %s is not a profile\n", argv[1]);
+		return -1;
+	}
+
+	//Load the samples
+	while(fgets(line, LINE_SIZE, f) != NULL){
+		if(n == cap){
+			cap = cap ? cap * 2 : 1024;
+			samples = realloc(samples, sizeof(struct sample) * cap);
+		}
+		tok = strtok(line, " \n");
+		samples[n].tid = atoi(tok);
+		samples[n].depth = 0;
+		while((tok = strtok(NULL, " \n")) != NULL && samples[n].depth <= PROF_MAX_DEPTH){
+			samples[n].pc[samples[n].depth++] = strtoul(tok, NULL, 16);
+		}
+		if(samples[n].depth > 0) n++;
+	}
+	fclose(f);
+
+	//Resolve every distinct address with a single addr2line run
+	addrs = malloc(sizeof(unsigned long) * (n * (PROF_MAX_DEPTH + 1) + 1));
+	for(i=0; i<n; i++)
+		for(j=0; j<samples[i].depth; j++)
+			addrs[naddrs++] = lookup_addr(&samples[i], j);
+	qsort(addrs, naddrs, sizeof(unsigned long), cmp_addr);
+
+	if((fd = mkstemp(tmp)) == -1 || (f = fdopen(fd, "w")) == NULL){
+		perror("*** ERROR: creating temporary file");
+		return -1;
+	}
+	syms = malloc(sizeof(struct symbol) * (naddrs + 1));
+	for(i=0; i<naddrs; i++){
+		if(i > 0 && addrs[i] == addrs[i-1]) continue;
+		syms[nsyms++].addr = addrs[i];
+		fprintf(f, "%lx\n", addrs[i] - base);
+	}
+	fclose(f);
+
+	snprintf(cmd, sizeof(cmd), "addr2line -f -e '%s' < %s", exe, tmp);
+	if((p = popen(cmd, "r")) == NULL){
+		perror("*** ERROR: running addr2line");
+		return -1;
+	}
+	for(i=0; i<nsyms; i++){
+		//addr2line prints the function and then its file and line
+		if(fgets(line, LINE_SIZE, p) == NULL) break;
+		line[strcspn(line, "\n")] = '\0';
+		if(strcmp(line, "??") == 0) snprintf(syms[i].name, sizeof(syms[i].name), "0x%lx", syms[i].addr);
+		else snprintf(syms[i].name, sizeof(syms[i].name), "%.255s", line);
+		if(fgets(line, LINE_SIZE, p) == NULL) break;
+	}
+	for(; i<nsyms; i++){
+		snprintf(syms[i].name, sizeof(syms[i].name), "0x%lx", syms[i].addr);
+	}
+	pclose(p);
+	unlink(tmp);
+
+	//Build the folded stacks, outermost frame first, and count equal ones
+	stacks = malloc(sizeof(char *) * (n + 1));
+	for(i=0; i<n; i++){
+		stacks[i] = malloc(LINE_SIZE);
+		snprintf(stacks[i], LINE_SIZE, "thread_%d", samples[i].tid);
+		for(j=samples[i].depth-1; j>=0; j--){
+			key.addr = lookup_addr(&samples[i], j);
+			sym = bsearch(&key, syms, nsyms, sizeof(struct symbol), cmp_symbol);
+			strncat(stacks[i], ";", LINE_SIZE - strlen(stacks[i]) - 1);
+			strncat(stacks[i], sym->name, LINE_SIZE - strlen(stacks[i]) - 1);
+		}
+	}
+	qsort(stacks, n, sizeof(char *), cmp_string);
+	for(i=0; i<n; i=j){
+		for(j=i+1; j<n && strcmp(stacks[i], stacks[j]) == 0; j++);
+		printf("%s %d\n", stacks[i], j - i);
+	}
+	if(dropped > 0){
+		fprintf(stderr, "%ld samples dropped\n", dropped);
+	}
+
+	for(i=0; i<n; i++) free(stacks[i]);
+	free(stacks);
+	free(syms);
+	free(addrs);
+	free(samples);
+	return 0;
+}
@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ucontext.h>
+#include <link.h>
+
+#include "mythread.h"
+#include "interrupt.h"
+#include "profiler.h"
+
+/* One sample: thread, interrupted PC and return addresses, innermost first */
+struct prof_sample{
+	int tid;
+	int depth;
+	uintptr_t pc[PROF_MAX_DEPTH + 1];
+};
+
+static struct prof_sample *samples = NULL;
+static int max_samples = 0;
+static int max_depth = 0;
+static int next_sample = 0; /* next free sample, only advanced by the tick hook */
+static long dropped = 0; /* samples lost because the buffer was full */
+
+/* Read the PC, stack and frame pointers of an interrupted context */
+static int prof_regs(ucontext_t *uc, uintptr_t *pc, uintptr_t *sp, uintptr_t *fp){
+#if defined(__x86_64__)
+	*pc = uc->uc_mcontext.gregs[REG_RIP];
+	*sp = uc->uc_mcontext.gregs[REG_RSP];
+	*fp = uc->uc_mcontext.gregs[REG_RBP];
+	return 0;
+#elif defined(__aarch64__)
+	*pc = uc->uc_mcontext.pc;
+	*sp = uc->uc_mcontext.sp;
+	*fp = uc->uc_mcontext.regs[29];
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* Tick hook: runs inside the SIGVTALRM handler, so it only touches the preallocated buffer */
+static void prof_tick(void *ctx){
+	struct prof_sample *s;
+	uintptr_t pc, sp, fp, lo, hi, *frame;
+	void *base;
+	size_t size;
+	int i;
+
+	if(prof_regs(ctx, &pc, &sp, &fp) == -1) return;
+	i = __atomic_fetch_add(&next_sample, 1, __ATOMIC_RELAXED);
+	if(i >= max_samples){
+		dropped++;
+		return;
+	}
+	s = &samples[i];
+	s->tid = mythread_gettid();
+	s->pc[0] = pc;
+	s->depth = 1;
+
+	//Follow the frame pointers only inside a stack whose bounds are known
+	if(max_depth == 0 || mythread_getstack(s->tid, &base, &size) == -1) return;
+	lo = sp > (uintptr_t) base ? sp : (uintptr_t) base;
+	hi = (uintptr_t) base + size - 2 * sizeof(uintptr_t);
+	while(s->depth <= max_depth && fp >= lo && fp <= hi && (fp & (sizeof(uintptr_t) - 1)) == 0){
+		frame = (uintptr_t *) fp;
+		if(frame[1] == 0) break;
+		s->pc[s->depth++] = frame[1];
+		if(frame[0] <= fp) break;
+		fp = frame[0];
+	}
+}
+
+int prof_start(int nsamples, int depth)
+{
+	if(nsamples <= 0 || depth < 0 || depth > PROF_MAX_DEPTH) return -1;
+
+	set_tick_hook(NULL);
+	free(samples);
+	if((samples = malloc(sizeof(struct prof_sample) * nsamples)) == NULL){
+		return -1;
+	}
+	max_samples = nsamples;
+	max_depth = depth;
+	next_sample = 0;
+	dropped = 0;
+	set_tick_hook(prof_tick);
+	return 0;
+}
+
+void prof_stop()
+{
+	set_tick_hook(NULL);
+}
+
+/* Load address of the executable, needed to symbolise position independent code */
+static int prof_base(struct dl_phdr_info *info, size_t size, void *data){
+	*(uintptr_t *) data = info->dlpi_addr;
+	return 1;
+}
+
+/* Text format: a header with the executable and its load address, then one line
+per sample with the thread id and the addresses from the innermost frame out */
+int prof_dump(const char *path)
+{
+	FILE *f;
+	char exe[4096];
+	ssize_t len;
+	uintptr_t base = 0;
+	int i, j, n;
+
+	if(samples == NULL) return -1;
+	if((len = readlink("/proc/self/exe", exe, sizeof(exe) - 1)) == -1) return -1;
+	exe[len] = '\0';
+	dl_iterate_phdr(prof_base, &base);
+
+	if((f = fopen(path, "w")) == NULL) return -1;
+	n = next_sample < max_samples ? next_sample : max_samples;
+	fprintf(f, "exe %s\nbase %lx\ndropped %ld\n", exe, (unsigned long) base, dropped);
+	for(i=0; i<n; i++){
+		fprintf(f, "%d", samples[i].tid);
+		for(j=0; j<samples[i].depth; j++){
+			fprintf(f, " %lx", (unsigned long) samples[i].pc[j]);
+		}
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	return n;
+}
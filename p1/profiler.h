@@ -0,0 +1,16 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#define PROF_MAX_DEPTH 16
+
+/* Start sampling the running thread on every clock tick. Up to max_samples samples
+are kept, each with the interrupted PC and up to depth return addresses.
+Returns 0 if correct or -1 in case of error */
+int prof_start(int max_samples, int depth);
+/* Stop sampling */
+void prof_stop();
+/* Write the samples to path, to be symbolised by prof_report.
+Returns the number of samples written or -1 in case of error */
+int prof_dump(const char *path);
+
+#endif
@@ -0,0 +1,335 @@
+/* Deterministic discrete-event simulator for the scheduling policies.
+
+The policy file (RR.c, RRF.c or RRFN.c) is linked unmodified in place of the
+interrupt library: there are no signals, the clock is virtual and every tick is
+delivered by calling timer_interrupt() directly. Each job of the trace is a
+mythread whose body consumes its CPU bursts one virtual tick at a time and calls
+read_network() between bursts, so scheduler(), activator() and the queues are
+the same code that runs on the real library.
+
+The policy file is compiled with these hooks (see the sim_% rule in the Makefile):
+	makecontext	the first context made is the idle thread, which is replaced
+			by one that advances the virtual clock
+	setcontext/swapcontext	count the context switches
+	exit		the policy ends the program when nothing is ready; the
+			simulation goes on while there are jobs left to arrive
+	enqueue		the idle thread is never queued
+
+RR and RRF never run their idle thread on the real library, as they exit
+instead, so they do not leave it by themselves: they would queue it as one more
+thread, or in RRF never switch from it. Each tick the simulator hands the
+processor to the thread the policy picks when the idle thread runs.
+
+The report on stdout is the same on every run of the same trace or seed; the
+wall-clock speed of the simulation goes to stderr.
+
+Usage: ./sim_<policy> [-n net_ticks] [-t max_ticks] (-r jobs [-s seed] | trace)
+Trace lines: <arrival tick> <priority 0|1> <burst ticks> [<burst ticks>...] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "mythread.h"
+#include "queue.h"
+#include "trace.h"
+
+#undef exit
+#undef makecontext
+#undef setcontext
+#undef swapcontext
+#undef enqueue
+
+#ifndef SIM_POLICY
+#define SIM_POLICY "?"
+#endif
+
+#define NET_TICKS (NET_TIME / TICK_TIME)	/* default period of the network interrupt */
+#define GAP_STACK 65536
+
+/* Policy entry points, defined in the policy file */
+TCB* scheduler();
+void activator(TCB* next);
+void timer_interrupt(int sig);
+void network_interrupt(int sig);
+
+static long now = 0; /* virtual clock, in ticks */
+static long next_job = 0; /* first job not admitted yet */
+static long completed = 0;
+static long net_ticks = NET_TICKS;
+static long horizon = 0; /* give up at this tick: a policy may starve jobs forever */
+
+static long switches = 0, idle_ticks = 0, events = 0, net_events = 0;
+static struct timespec wall_start;
+
+static long job_of_tid[N]; /* job run by each thread */
+static int tid_busy[N]; /* mirror of the TCBs in use, to know the tid of a new thread */
+static int nbusy = 0;
+static int contexts_made = 0;
+
+static ucontext_t gap_env;
+static char gap_stack[GAP_STACK];
+
+static void sim_report();
+
+/********************/
+/* Policy hooks     */
+/********************/
+
+/* The idle thread of the policy: let virtual time pass */
+static void sim_idle(){
+	void sim_tick();
+
+	while(1){
+		idle_ticks++;
+		sim_tick();
+	}
+}
+
+/* init_mythreadlib makes the idle context before any thread. Threads are made with
+one declared argument that the policies never pass, so none is given */
+void sim_makecontext(ucontext_t *ucp, void (*func)(), int argc, ...)
+{
+	if(contexts_made++ == 0){
+		makecontext(ucp, sim_idle, 0);
+	}
+	else{
+		makecontext(ucp, func, 0);
+	}
+}
+
+int sim_setcontext(const ucontext_t *ucp)
+{
+	switches++;
+	return setcontext(ucp);
+}
+
+int sim_swapcontext(ucontext_t *oucp, const ucontext_t *ucp)
+{
+	switches++;
+	return swapcontext(oucp, ucp);
+}
+
+/* Every call to enqueue in the policies queues a TCB */
+struct queue* sim_enqueue(struct queue *q, void *data)
+{
+	if(((TCB *) data)->state == IDLE){
+		return q;
+	}
+	return enqueue(q, data);
+}
+
+/* Interrupt library: nothing to mask without signals */
+void init_interrupt(){}
+void disable_interrupt(){}
+void enable_interrupt(){}
+void init_network_interrupt(){}
+void set_network_period(long usec){}
+void disable_network_interrupt(){}
+void enable_network_interrupt(){}
+
+/********************/
+/* Jobs             */
+/********************/
+
+/* Body of every job thread */
+static void sim_job(){
+	int tid = mythread_gettid();
+	struct job *j = &jobs[job_of_tid[tid]];
+	long b, t;
+	void sim_tick();
+
+	j->start = now;
+	for(b=0; b<j->nbursts; b++){
+		if(b > 0){
+			read_network();
+		}
+		for(t=0; t<bursts[j->first + b]; t++){
+			sim_tick();
+		}
+	}
+	j->finish = now;
+	completed++;
+	tid_busy[tid] = 0;
+	nbusy--;
+	mythread_exit();
+}
+
+/* Create the threads of the jobs that have arrived. While every block is in use they wait */
+static void sim_admit(){
+	int tid;
+
+	while(next_job < njobs && jobs[next_job].arrival <= now && nbusy < N){
+		for(tid=0; tid<N && tid_busy[tid]; tid++);
+
+		events++;
+		job_of_tid[tid] = next_job++;
+		tid_busy[tid] = 1;
+		nbusy++;
+		if(mythread_create(sim_job, jobs[job_of_tid[tid]].priority) != tid){
+			printf("*** ERROR: the policy did not give thread %d to the new job\n", tid);
+			exit(-1);
+		}
+	}
+}
+
+/* One tick of the virtual clock: arrivals, network packets and the clock interrupt */
+void sim_tick()
+{
+	TCB *next;
+
+	now++;
+	events++;
+	if(completed == njobs || now >= horizon){
+		sim_report();
+	}
+	sim_admit();
+	if(net_ticks > 0 && now % net_ticks == 0){
+		events++;
+		net_events++;
+		network_interrupt(0);
+	}
+	timer_interrupt(0);
+	//Still on the idle thread: leave it for the thread the policy would run, if any
+	if(mythread_gettid() == -1 && (next = scheduler())->state != IDLE){
+		disable_interrupt();
+		activator(next);
+	}
+}
+
+/* Runs on its own stack when the policy found nothing to run. Jobs are not created
+here, as the first one would take the block of the thread that just exited while the
+policy still runs it: the policy goes to its idle thread instead, with the clock moved
+to just before the next arrival */
+static void sim_gap(){
+	if(completed == njobs || next_job == njobs){
+		sim_report();
+	}
+	if(jobs[next_job].arrival > now + 1){
+		idle_ticks += jobs[next_job].arrival - 1 - now;
+		now = jobs[next_job].arrival - 1;
+	}
+	activator(scheduler());
+	printf("*** ERROR: nothing to run after tick %ld\n", now);
+	exit(-1);
+}
+
+void sim_exit(int status)
+{
+	if(status != 0){
+		exit(status);
+	}
+	//We may be on the stack of a thread that was just freed
+	getcontext(&gap_env);
+	gap_env.uc_stack.ss_sp = gap_stack;
+	gap_env.uc_stack.ss_size = GAP_STACK;
+	gap_env.uc_link = NULL;
+	makecontext(&gap_env, sim_gap, 0);
+	setcontext(&gap_env);
+	exit(-1);
+}
+
+/********************/
+/* Workload         */
+/********************/
+
+/* Random mix: one job in four is high priority and one in three waits for the network */
+static void random_trace(long n, unsigned long long seed){
+	long i, arrival = 0;
+	int b, nb;
+
+	rng_seed(seed);
+	for(i=0; i<n; i++){
+		arrival += rng() % (2 * QUANTUM_TICKS);
+		add_job(arrival, rng() % 4 == 0 ? HIGH_PRIORITY : LOW_PRIORITY);
+		nb = rng() % 3 == 0 ? 1 + rng() % 3 : 0;
+		for(b=0; b<=nb; b++){
+			add_burst(1 + rng() % (3 * QUANTUM_TICKS));
+		}
+	}
+}
+
+/********************/
+/* Report           */
+/********************/
+
+static void sim_report(){
+	struct timespec wall_end;
+	long i, *turnaround, *response;
+	double secs;
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+	secs = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+	events += switches;
+
+	printf("policy       %s\n", SIM_POLICY);
+	printf("jobs         %ld completed of %ld\n", completed, njobs);
+	printf("time         %ld ticks, %ld idle (%.1f%% busy)\n", now, idle_ticks,
+		now ? 100.0 * (now - idle_ticks) / now : 0.0);
+	printf("throughput   %.3f jobs per 1000 ticks\n", now ? 1000.0 * completed / now : 0.0);
+	printf("switches     %ld\n", switches);
+	printf("packets      %ld\n", net_events);
+
+	turnaround = malloc(sizeof(long) * (completed + 1));
+	response = malloc(sizeof(long) * (completed + 1));
+	for(i=0, completed=0; i<njobs; i++){
+		if(jobs[i].finish == -1) continue;
+		turnaround[completed] = jobs[i].finish - jobs[i].arrival;
+		response[completed] = jobs[i].start - jobs[i].arrival;
+		completed++;
+	}
+	if(completed > 0){
+		print_percentiles("turnaround", turnaround, completed, 1, "ticks");
+		print_percentiles("response", response, completed, 1, "ticks");
+	}
+	fflush(stdout);
+	//Wall-clock time changes from run to run: kept out of stdout, so the same trace gives the same output
+	fprintf(stderr, "simulated    %ld events in %.3f s (%.2f M events/s)\n", events, secs, secs > 0 ? events / secs / 1e6 : 0.0);
+	exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+	long n = 0;
+	unsigned long long seed = 1;
+	long i;
+	char *trace = NULL;
+
+	for(i=1; i<argc; i++){
+		if(strcmp(argv[i], "-n") == 0 && i+1 < argc) net_ticks = atol(argv[++i]);
+		else if(strcmp(argv[i], "-r") == 0 && i+1 < argc) n = atol(argv[++i]);
+		else if(strcmp(argv[i], "-s") == 0 && i+1 < argc) seed = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "-t") == 0 && i+1 < argc) horizon = atol(argv[++i]);
+		else trace = argv[i];
+	}
+	if(n > 0) random_trace(n, seed);
+	else if(trace == NULL || load_trace(trace) == -1){
+		printf("Syntax: ./sim_%s [-n net_ticks] [-t max_ticks] (-r jobs [-s seed] | trace)\n", SIM_POLICY);
+		return -1;
+	}
+	if(njobs == 0){
+		printf("*** ERROR: empty trace\n");
+		return -1;
+	}
+	//By default, time enough to run every burst many times over after the last arrival
+	if(horizon <= 0){
+		horizon = jobs[njobs-1].arrival + 1000;
+		for(i=0; i<njobs; i++){
+			horizon += 4 * jobs[i].nbursts * net_ticks;
+		}
+		for(i=0; i<nbursts_total; i++){
+			horizon += 4 * bursts[i];
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+	//The main thread only starts the library; the jobs are admitted as the policy runs out of work
+	tid_busy[0] = 1;
+	mythread_gettid();
+	tid_busy[0] = 0;
+	mythread_exit();
+	return 0;
+}
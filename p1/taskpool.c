@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mythread.h"
+#include "taskpool.h"
+
+/* Remove the first pending task, NULL if there is none */
+static task_t* pool_pop(taskpool_t *pool){
+	task_t *t;
+
+	mythread_preempt_disable();
+	t = pool->head;
+	if(t != NULL){
+		pool->head = t->next;
+		if(pool->head == NULL) pool->tail = NULL;
+	}
+	mythread_preempt_enable();
+	return t;
+}
+
+/* Run a task and mark it as done */
+static void pool_run(task_t *t){
+	t->fn(t->arg);
+	t->done = 1;
+}
+
+/* Body of the worker threads: run tasks until the pool is stopped and drained */
+static void pool_worker(void *arg){
+	taskpool_t *pool = arg;
+	task_t *t;
+
+	while(1){
+		if((t = pool_pop(pool)) != NULL){
+			pool_run(t);
+		}
+		else if(pool->stop){
+			break;
+		}
+		else{
+			mythread_yield();
+		}
+	}
+
+	mythread_preempt_disable();
+	pool->workers--;
+	mythread_preempt_enable();
+}
+
+/* Create the worker threads of the pool */
+int taskpool_init(taskpool_t *pool, int nworkers, const mythread_attr_t *attr)
+{
+	int i;
+
+	pool->head = pool->tail = NULL;
+	pool->stop = 0;
+	pool->workers = 0;
+
+	for(i=0; i<nworkers; i++){
+		mythread_preempt_disable();
+		pool->workers++;
+		mythread_preempt_enable();
+		if(mythread_create_arg(pool_worker, pool, attr) == -1){
+			pool->workers--;
+			taskpool_shutdown(pool);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Submit a task: a push to the tail of the submission queue */
+void taskpool_submit(taskpool_t *pool, task_t *task, void (*fn)(void *), void *arg)
+{
+	task->fn = fn;
+	task->arg = arg;
+	task->done = 0;
+	task->next = NULL;
+
+	mythread_preempt_disable();
+	if(pool->tail == NULL){
+		pool->head = pool->tail = task;
+	}
+	else{
+		pool->tail->next = task;
+		pool->tail = task;
+	}
+	mythread_preempt_enable();
+}
+
+int taskpool_done(task_t *task)
+{
+	return task->done;
+}
+
+/* The caller helps with the pending tasks, so waiting from a thread with higher
+priority than the workers does not starve them */
+void taskpool_wait(taskpool_t *pool, task_t *task)
+{
+	task_t *t;
+
+	while(!task->done){
+		if((t = pool_pop(pool)) != NULL){
+			pool_run(t);
+		}
+		else{
+			mythread_yield();
+		}
+	}
+}
+
+void taskpool_shutdown(taskpool_t *pool)
+{
+	pool->stop = 1;
+	while(pool->workers > 0){
+		mythread_yield();
+	}
+}
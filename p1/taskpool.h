@@ -0,0 +1,35 @@
+#ifndef _TASKPOOL_H_
+#define _TASKPOOL_H_
+
+#include "mythread.h"
+
+/* Task handle. It is owned by the caller and must stay alive until the task is done */
+typedef struct task{
+	void (*fn)(void *); /* the code of the task */
+	void *arg; /* argument passed to fn */
+	volatile int done; /* 1 once fn has returned */
+	struct task *next; /* next task in the submission queue */
+}task_t;
+
+/* Set of long lived worker threads pulling tasks from a submission queue */
+typedef struct taskpool{
+	task_t *head; /* first pending task */
+	task_t *tail; /* last pending task */
+	volatile int workers; /* workers still alive */
+	volatile int stop; /* set by taskpool_shutdown */
+}taskpool_t;
+
+/* Create nworkers workers with the given attributes (NULL for the defaults).
+Returns 0 if correct or -1 if the threads can not be created */
+int taskpool_init(taskpool_t *pool, int nworkers, const mythread_attr_t *attr);
+/* Queue fn(arg) using task as its completion handle */
+void taskpool_submit(taskpool_t *pool, task_t *task, void (*fn)(void *), void *arg);
+/* Return 1 if the task has finished and 0 otherwise */
+int taskpool_done(task_t *task);
+/* Wait for a task, running pending tasks meanwhile */
+void taskpool_wait(taskpool_t *pool, task_t *task);
+/* Let the workers finish the pending tasks and wait for them to exit.
+The caller must not have higher priority than the workers */
+void taskpool_shutdown(taskpool_t *pool);
+
+#endif
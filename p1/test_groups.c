@@ -0,0 +1,72 @@
+/* Test of the fairness between thread groups when a group wakes from idle.
+
+Two groups of the same weight: the thread of A runs all the time, the one of B
+sleeps in read_network() for SLEEP_WAITS periods of the network, so A runs alone
+and its vruntime grows. When B wakes it must start from the vruntime of A and
+share the processor: while B runs WINDOW ticks, A has to run about as long. If
+B kept the credit of its sleep, A would not run at all until B caught up.
+
+Usage: ./test_groups */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mythread.h"
+
+#define NET_PERIOD 500000	/* microseconds between packets */
+#define SLEEP_WAITS 2		/* packets B waits for, while A runs alone */
+#define WINDOW 100			/* ticks B runs after waking */
+
+static int group_a, group_b;
+
+static long runtime(int g){
+	mythread_group_stats_t st;
+
+	mythread_group_getstats(g, &st);
+	return st.runtime;
+}
+
+static void spin_a(){
+	mythread_group_join(group_a);
+	mythread_yield();
+	while(1);
+}
+
+static void sleep_then_spin_b(){
+	long a0, b0, a1;
+	int i;
+
+	mythread_group_join(group_b);
+	for(i=0; i<SLEEP_WAITS; i++){
+		read_network();
+	}
+	a0 = runtime(group_a);
+	b0 = runtime(group_b);
+	while(runtime(group_b) - b0 < WINDOW);
+	a1 = runtime(group_a);
+
+	printf("group A ran %ld ticks alone, then %ld while B ran %d\n", a0, a1 - a0, WINDOW);
+	if(a1 - a0 < WINDOW / 2){
+		printf("*** ERROR: the group that woke up starved its sibling\n");
+		exit(-1);
+	}
+	printf("test_groups: OK\n");
+	exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+	mythread_setpriority(LOW_PRIORITY);
+	set_network_period(NET_PERIOD);
+	if((group_a = mythread_group_create(-1, GROUP_WEIGHT, 0)) == -1 ||
+			(group_b = mythread_group_create(-1, GROUP_WEIGHT, 0)) == -1){
+		printf("*** ERROR: cannot create the groups\n");
+		return -1;
+	}
+	if(mythread_create(sleep_then_spin_b, LOW_PRIORITY) == -1 || mythread_create(spin_a, LOW_PRIORITY) == -1){
+		printf("*** ERROR: cannot create the threads\n");
+		return -1;
+	}
+	mythread_exit();
+	return 0;
+}
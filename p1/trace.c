@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mythread.h"
+#include "trace.h"
+
+struct job *jobs = NULL;
+long *bursts = NULL;
+long njobs = 0, nbursts_total = 0;
+
+static unsigned long long rng_state = 1;
+
+void add_job(long arrival, int priority){
+	if(njobs % 1024 == 0){
+		jobs = realloc(jobs, sizeof(struct job) * (njobs + 1024));
+	}
+	jobs[njobs].arrival = arrival;
+	jobs[njobs].priority = priority;
+	jobs[njobs].nbursts = 0;
+	jobs[njobs].first = nbursts_total;
+	jobs[njobs].start = jobs[njobs].finish = -1;
+	njobs++;
+}
+
+void add_burst(long ticks){
+	if(nbursts_total % 4096 == 0){
+		bursts = realloc(bursts, sizeof(long) * (nbursts_total + 4096));
+	}
+	bursts[nbursts_total++] = ticks;
+	jobs[njobs-1].nbursts++;
+}
+
+int load_trace(const char *path){
+	FILE *f;
+	char line[4096], *tok;
+	long arrival, last = 0;
+	int priority;
+
+	if((f = fopen(path, "r")) == NULL){
+		perror("*** ERROR: opening trace");
+		return -1;
+	}
+	while(fgets(line, sizeof(line), f) != NULL){
+		if(line[0] == '#' || sscanf(line, "%ld %d", &arrival, &priority) != 2) continue;
+		if(arrival < last){
+			printf("*** ERROR: trace arrivals must be sorted\n");
+			fclose(f);
+			return -1;
+		}
+		last = arrival;
+		add_job(arrival, priority == HIGH_PRIORITY ? HIGH_PRIORITY : LOW_PRIORITY);
+		strtok(line, " \t\n");
+		strtok(NULL, " \t\n");
+		while((tok = strtok(NULL, " \t\n")) != NULL){
+			add_burst(atol(tok));
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+int save_trace(const char *path){
+	FILE *f;
+	long i, b;
+
+	if((f = fopen(path, "w")) == NULL){
+		perror("*** ERROR: creating trace");
+		return -1;
+	}
+	fprintf(f, "# arrival priority bursts... (ticks of %d us)\n", TICK_TIME);
+	for(i=0; i<njobs; i++){
+		fprintf(f, "%ld %d", jobs[i].arrival, jobs[i].priority);
+		for(b=0; b<jobs[i].nbursts; b++){
+			fprintf(f, " %ld", bursts[jobs[i].first + b]);
+		}
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	return 0;
+}
+
+void rng_seed(unsigned long long seed){
+	rng_state = seed ? seed : 1;
+}
+
+unsigned long rng(){
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (rng_state * 2685821657736338717ULL) >> 33;
+}
+
+static int cmp_long(const void *a, const void *b){
+	long x = *(const long *) a, y = *(const long *) b;
+	return x < y ? -1 : x > y;
+}
+
+void print_percentiles(const char *name, long *v, long n, double scale, const char *unit){
+	int digits = scale > 1;
+
+	qsort(v, n, sizeof(long), cmp_long);
+	printf("%-12s p50 %8.*f  p90 %8.*f  p99 %8.*f  max %8.*f %s\n", name,
+		digits, v[n * 50 / 100] / scale, digits, v[n * 90 / 100] / scale,
+		digits, v[n * 99 / 100] / scale, digits, v[n - 1] / scale, unit);
+}
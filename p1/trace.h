@@ -0,0 +1,36 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/* Workloads of the simulator (sim.c) and the load generator (workload.c). A trace
+has one line per job, "<arrival tick> <priority 0|1> <burst ticks>...", where a
+tick is TICK_TIME microseconds; lines starting with '#' are comments */
+
+struct job{
+	long arrival; /* tick the job arrives */
+	int priority;
+	int nbursts; /* CPU bursts, separated by read_network */
+	long first; /* index of the first burst in bursts */
+	long start, finish; /* first dispatch and exit, -1 before. In ticks in sim.c, microseconds in workload.c */
+};
+
+extern struct job *jobs;
+extern long *bursts;
+extern long njobs, nbursts_total;
+
+/* Append a job, and a burst to the last job */
+void add_job(long arrival, int priority);
+void add_burst(long ticks);
+/* Append the jobs of the trace at path, sorted by arrival.
+Returns 0 if correct or -1 in case of error */
+int load_trace(const char *path);
+/* Write the jobs to path. Returns 0 if correct or -1 in case of error */
+int save_trace(const char *path);
+
+/* xorshift64*: the same seed always gives the same workload */
+void rng_seed(unsigned long long seed);
+unsigned long rng();
+
+/* Sort v and print its percentiles, divided by scale, in unit */
+void print_percentiles(const char *name, long *v, long n, double scale, const char *unit);
+
+#endif
@@ -0,0 +1,230 @@
+/* Load generator for the thread library.
+
+Creates a mix of threads at a given arrival rate and reports throughput and
+latency percentiles. Every thread is a list of CPU bursts separated by
+read_network() calls:
+	cpu	one long burst
+	io	several short bursts, waiting for the network between them
+	bursty	a few long bursts, waiting for the network between them
+
+A run can be recorded to a trace (-w) and replayed later from it. The trace
+holds what the run observed, not the plan: each thread arrives at the tick it
+was created and each burst lasts the ticks it ran, as counted by the library.
+Traces use the format of sim.c (see trace.h), so the same file runs on the real
+library and on the simulator.
+
+Usage: ./workload [-j jobs] [-a mean_arrival_ticks] [-m cpu:io:bursty] [-h high_percent]
+		[-n net_usec] [-s seed] [-w record_run] [replay] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mythread.h"
+#include "trace.h"
+
+static long *released = NULL; /* tick each job was created */
+static long *ran = NULL; /* ticks each burst ran */
+static char *record = NULL;
+
+static volatile long completed = 0;
+static long preemptions = 0, yields = 0; /* of the finished jobs */
+static struct timespec t0;
+static double loops_per_tick;
+
+static long now_usec(){
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0.tv_sec) * 1000000 + (t.tv_nsec - t0.tv_nsec) / 1000;
+}
+
+/* Busy loop, so that a burst costs processor time and can be preempted */
+static void spin(double loops){
+	volatile long i;
+
+	for(i=0; i<(long) loops; i++);
+}
+
+/* Loops of spin() in one tick, measured before the timers start */
+static void calibrate(){
+	long start, elapsed, loops = 1000000;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do{
+		loops *= 2;
+		start = now_usec();
+		spin(loops);
+		elapsed = now_usec() - start;
+	}while(elapsed < 20000);
+	loops_per_tick = (double) loops * TICK_TIME / elapsed;
+}
+
+/********************/
+/* Workload         */
+/********************/
+
+static long uniform(long lo, long hi){
+	return lo + rng() % (hi - lo + 1);
+}
+
+static void generate(long n, long mean_arrival, int mix[3], int high, unsigned long long seed){
+	long i, arrival = 0;
+	int b, nb, kind, total = mix[0] + mix[1] + mix[2];
+
+	rng_seed(seed);
+	for(i=0; i<n; i++){
+		arrival += mean_arrival > 0 ? uniform(0, 2 * mean_arrival) : 0;
+		add_job(arrival, (long) (rng() % 100) < high ? HIGH_PRIORITY : LOW_PRIORITY);
+		kind = rng() % total;
+		if(kind < mix[0]){
+			add_burst(uniform(QUANTUM_TICKS / 4, QUANTUM_TICKS));
+		}
+		else if(kind < mix[0] + mix[1]){
+			nb = uniform(2, 5);
+			for(b=0; b<nb; b++) add_burst(uniform(1, QUANTUM_TICKS / 10));
+		}
+		else{
+			nb = uniform(2, 4);
+			for(b=0; b<nb; b++) add_burst(uniform(QUANTUM_TICKS / 4, QUANTUM_TICKS / 2));
+		}
+	}
+}
+
+/********************/
+/* Report           */
+/********************/
+
+/* Latencies count from the time the job should have arrived, so a late generator shows up as queueing */
+static void report(){
+	long i, end = now_usec(), *turnaround, *response;
+
+	turnaround = malloc(sizeof(long) * njobs);
+	response = malloc(sizeof(long) * njobs);
+	for(i=0; i<njobs; i++){
+		turnaround[i] = jobs[i].finish - jobs[i].arrival * TICK_TIME;
+		response[i] = jobs[i].start - jobs[i].arrival * TICK_TIME;
+	}
+	printf("jobs         %ld in %.2f s\n", njobs, end / 1e6);
+	printf("throughput   %.1f jobs/s\n", njobs / (end / 1e6));
+	printf("switches     %ld preemptions, %ld yields and waits\n", preemptions, yields);
+	print_percentiles("turnaround", turnaround, njobs, 1e3, "ms");
+	print_percentiles("response", response, njobs, 1e3, "ms");
+	free(turnaround);
+	free(response);
+}
+
+/* Write the run as it happened, with the plan replaced by what was observed */
+static void save_run(){
+	long i;
+
+	for(i=0; i<njobs; i++){
+		jobs[i].arrival = released[i];
+	}
+	memcpy(bursts, ran, sizeof(long) * nbursts_total);
+	if(save_trace(record) == 0){
+		printf("recorded     %s\n", record);
+	}
+}
+
+/********************/
+/* Threads          */
+/********************/
+
+static void job_body(void *arg){
+	struct job *j = arg;
+	mythread_stats_t st;
+	long b, ticks = 0;
+
+	j->start = now_usec();
+	for(b=0; b<j->nbursts; b++){
+		if(b > 0){
+			read_network();
+		}
+		spin(bursts[j->first + b] * loops_per_tick);
+		mythread_getstats(mythread_gettid(), &st);
+		ran[j->first + b] = st.ticks - ticks;
+		ticks = st.ticks;
+	}
+	j->finish = now_usec();
+	preemptions += st.preemptions;
+	yields += st.yields;
+	if(++completed == njobs){
+		report();
+		if(record != NULL){
+			save_run();
+		}
+	}
+	mythread_exit();
+}
+
+int main(int argc, char *argv[])
+{
+	long i, n = 100, mean_arrival = QUANTUM_TICKS, net = NET_TIME;
+	int mix[3] = {1, 1, 1}, high = 10;
+	unsigned long long seed = 1;
+	char *replay = NULL;
+	mythread_attr_t attr;
+
+	for(i=1; i<argc; i++){
+		if(strcmp(argv[i], "-j") == 0 && i+1 < argc) n = atol(argv[++i]);
+		else if(strcmp(argv[i], "-a") == 0 && i+1 < argc) mean_arrival = atol(argv[++i]);
+		else if(strcmp(argv[i], "-m") == 0 && i+1 < argc) sscanf(argv[++i], "%d:%d:%d", &mix[0], &mix[1], &mix[2]);
+		else if(strcmp(argv[i], "-h") == 0 && i+1 < argc) high = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-n") == 0 && i+1 < argc) net = atol(argv[++i]);
+		else if(strcmp(argv[i], "-s") == 0 && i+1 < argc) seed = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "-w") == 0 && i+1 < argc) record = argv[++i];
+		else if(argv[i][0] != '-') replay = argv[i];
+		else{
+			printf("Syntax: ./workload [-j jobs] [-a mean_arrival_ticks] [-m cpu:io:bursty] [-h high_percent]\n"
+				"\t[-n net_usec] [-s seed] [-w record_run] [replay]\n");
+			return -1;
+		}
+	}
+	if(mix[0] < 0 || mix[1] < 0 || mix[2] < 0 || mix[0] + mix[1] + mix[2] == 0){
+		printf("*** ERROR: bad thread mix\n");
+		return -1;
+	}
+
+	if(replay != NULL){
+		if(load_trace(replay) == -1) return -1;
+	}
+	else{
+		generate(n, mean_arrival, mix, high, seed);
+	}
+	if(njobs == 0){
+		printf("*** ERROR: empty workload\n");
+		return -1;
+	}
+	released = malloc(sizeof(long) * njobs);
+	ran = calloc(nbursts_total, sizeof(long));
+	if(released == NULL || ran == NULL){
+		printf("*** ERROR: out of memory\n");
+		return -1;
+	}
+
+	calibrate();
+	set_network_period(net);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	/* The generator releases the jobs on time, yielding while it waits. It stays at low
+	priority so that it does not take the processor from the jobs */
+	mythread_attr_init(&attr);
+	for(i=0; i<njobs; i++){
+		while(now_usec() < jobs[i].arrival * TICK_TIME){
+			mythread_yield();
+		}
+		attr.priority = jobs[i].priority;
+		//Set before the job can run, as it may be the last and save the run
+		released[i] = now_usec() / TICK_TIME;
+		while(mythread_create_arg(job_body, &jobs[i], &attr) == -1){
+			mythread_yield();	//Every block is in use: wait for a thread to exit
+			released[i] = now_usec() / TICK_TIME;
+		}
+	}
+	mythread_exit();
+
+	printf("This program should never come here\n");
+	return 0;
+}
@@ -0,0 +1,388 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	async.c
+ * @brief 	Asynchronous block I/O: io_uring through its system calls, a pool
+ * 			of threads when the kernel does not have it, and synchronous copies
+ * 			for RAM devices.
+ * @date	01/03/2017
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#undef BLOCK_SIZE		// the one of <linux/fs.h>, ours is in blocks_cache.h
+
+#include "backend.h"
+#include "device.h"
+#include "async.h"
+
+#define BIO_THREADS_MAX 4
+
+static struct {
+	int engine;					// 0 while not started
+	int depth;
+	int inflight;				// submitted and not yet completed
+	int fd;
+	pthread_mutex_t lock;		// protects the completed list and the pool queue
+	pthread_cond_t work, done;
+	struct bio_req *head, *tail;	// completed, waiting to be delivered
+} bio = {0, 0, 0, -1, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/* Called with the lock held if there are threads */
+static void bio_complete(struct bio_req *req, int status) {
+	req->status = status;
+	req->next = NULL;
+	if(bio.tail != NULL) bio.tail->next = req;
+	else bio.head = req;
+	bio.tail = req;
+}
+
+/* Transfers the whole request with pread()/pwrite() from block done on */
+static int bio_transfer(struct bio_req *req, int done) {
+	struct iovec iov;
+
+	iov.iov_base = req->buffer + (size_t) done * BLOCK_SIZE;
+	iov.iov_len = (size_t) (req->count - done) * BLOCK_SIZE;
+	return fd_blocks(bio.fd, req->first + done, &iov, 1, req->writing);
+}
+
+/*************/
+/* io_uring. */
+/*************/
+
+static struct {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	char *sq_ring, *cq_ring;
+	size_t sq_size, cq_size, sqes_size;
+} ring = {-1};
+
+static void uring_exit(void) {
+	if(ring.sqes != NULL && ring.sqes != MAP_FAILED) munmap(ring.sqes, ring.sqes_size);
+	if(ring.cq_ring != NULL && ring.cq_ring != MAP_FAILED && ring.cq_ring != ring.sq_ring) munmap(ring.cq_ring, ring.cq_size);
+	if(ring.sq_ring != NULL && ring.sq_ring != MAP_FAILED) munmap(ring.sq_ring, ring.sq_size);
+	if(ring.fd >= 0) close(ring.fd);
+	memset(&ring, 0, sizeof(ring));
+	ring.fd = -1;
+}
+
+static int uring_init(int depth) {
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	ring.fd = syscall(__NR_io_uring_setup, depth, &p);
+	if(ring.fd < 0){
+		ring.fd = -1;
+		return -1;
+	}
+
+	ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		if(ring.cq_size > ring.sq_size) ring.sq_size = ring.cq_size;
+		ring.cq_size = ring.sq_size;
+	}
+	ring.sq_ring = mmap(NULL, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+	if(ring.sq_ring == MAP_FAILED){
+		uring_exit();
+		return -1;
+	}
+	if(p.features & IORING_FEAT_SINGLE_MMAP){
+		ring.cq_ring = ring.sq_ring;
+	}
+	else{
+		ring.cq_ring = mmap(NULL, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+	}
+	ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring.sqes = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+	if(ring.cq_ring == MAP_FAILED || ring.sqes == MAP_FAILED){
+		uring_exit();
+		return -1;
+	}
+
+	ring.sq_head = (unsigned *) (ring.sq_ring + p.sq_off.head);
+	ring.sq_tail = (unsigned *) (ring.sq_ring + p.sq_off.tail);
+	ring.sq_mask = (unsigned *) (ring.sq_ring + p.sq_off.ring_mask);
+	ring.sq_array = (unsigned *) (ring.sq_ring + p.sq_off.array);
+	ring.cq_head = (unsigned *) (ring.cq_ring + p.cq_off.head);
+	ring.cq_tail = (unsigned *) (ring.cq_ring + p.cq_off.tail);
+	ring.cq_mask = (unsigned *) (ring.cq_ring + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *) (ring.cq_ring + p.cq_off.cqes);
+	return 0;
+}
+
+static void uring_queue(struct bio_req *req) {
+	unsigned tail = *ring.sq_tail, i = tail & *ring.sq_mask;
+	struct io_uring_sqe *sqe = &ring.sqes[i];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = req->writing ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = bio.fd;
+	sqe->addr = (unsigned long) req->buffer;
+	sqe->len = req->count * BLOCK_SIZE;
+	sqe->off = (unsigned long long) req->first * BLOCK_SIZE;
+	sqe->user_data = (unsigned long) req;
+	ring.sq_array[i] = i;
+	__atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Hands the queued requests to the kernel and, if wait, waits for one completion */
+static int uring_enter(int submit, int wait) {
+	int ret;
+
+	do{
+		ret = syscall(__NR_io_uring_enter, ring.fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	}while(ret < 0 && errno == EINTR);
+	return ret;
+}
+
+/* Moves the completions of the ring to the completed list. A short transfer is finished with pread()/pwrite() */
+static void uring_reap(void) {
+	unsigned head = *ring.cq_head, tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+	struct io_uring_cqe *cqe;
+	struct bio_req *req;
+	int res;
+
+	for(; head != tail; head++){
+		cqe = &ring.cqes[head & *ring.cq_mask];
+		req = (struct bio_req *) (unsigned long) cqe->user_data;
+		res = cqe->res;
+		if(res == req->count * BLOCK_SIZE){
+			bio_complete(req, 0);
+		}
+		else if(res >= 0 || res == -EINTR || res == -EAGAIN){
+			bio_complete(req, bio_transfer(req, res > 0 ? res / BLOCK_SIZE : 0));
+		}
+		else{
+			bio_complete(req, -1);
+		}
+		bio.inflight--;
+	}
+	__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+/************/
+/* Threads. */
+/************/
+
+static struct {
+	pthread_t threads[BIO_THREADS_MAX];
+	int nthreads;
+	int stop;
+	struct bio_req *head, *tail;	// waiting for a thread
+} pool;
+
+static void *pool_run(void *arg) {
+	struct bio_req *req;
+	int status;
+
+	pthread_mutex_lock(&bio.lock);
+	while(1){
+		while(!pool.stop && pool.head == NULL){
+			pthread_cond_wait(&bio.work, &bio.lock);
+		}
+		if(pool.head == NULL){
+			break;
+		}
+		req = pool.head;
+		pool.head = req->next;
+		if(pool.head == NULL) pool.tail = NULL;
+
+		pthread_mutex_unlock(&bio.lock);
+		status = bio_transfer(req, 0);
+		pthread_mutex_lock(&bio.lock);
+
+		bio_complete(req, status);
+		bio.inflight--;
+		pthread_cond_signal(&bio.done);
+	}
+	pthread_mutex_unlock(&bio.lock);
+	return NULL;
+}
+
+static int pool_init(int depth) {
+	pool.stop = 0;
+	pool.head = pool.tail = NULL;
+	for(pool.nthreads = 0; pool.nthreads < depth && pool.nthreads < BIO_THREADS_MAX; pool.nthreads++){
+		if(pthread_create(&pool.threads[pool.nthreads], NULL, pool_run, NULL) != 0){
+			break;
+		}
+	}
+	return pool.nthreads > 0 ? 0 : -1;
+}
+
+static void pool_exit(void) {
+	int i;
+
+	pthread_mutex_lock(&bio.lock);
+	pool.stop = 1;
+	pthread_cond_broadcast(&bio.work);
+	pthread_mutex_unlock(&bio.lock);
+	for(i = 0; i < pool.nthreads; i++){
+		pthread_join(pool.threads[i], NULL);
+	}
+	pool.nthreads = 0;
+}
+
+/********/
+/* API. */
+/********/
+
+int bio_init(int depth, int engine) {
+	if(bio.engine != 0 || depth <= 0 || engine < BIO_ANY || engine > BIO_THREADS){
+		return -1;
+	}
+	bio.depth = depth;
+	bio.inflight = 0;
+	bio.head = bio.tail = NULL;
+	bio.fd = dev_fd();
+
+	if(dev_size() < 0){
+		return -1;
+	}
+	if(bio.fd < 0){
+		bio.engine = BIO_SYNC;
+	}
+	else if(engine != BIO_THREADS && uring_init(depth) == 0){
+		bio.engine = BIO_URING;
+	}
+	else if(engine != BIO_URING && pool_init(depth) == 0){
+		bio.engine = BIO_THREADS;
+	}
+	return bio.engine != 0 ? bio.engine : -1;
+}
+
+/* Delivers the completed requests, calling their callbacks without the lock */
+static int bio_deliver(void) {
+	struct bio_req *req, *next;
+	int n = 0;
+
+	if(bio.engine == BIO_URING){
+		uring_reap();
+	}
+	pthread_mutex_lock(&bio.lock);
+	req = bio.head;
+	bio.head = bio.tail = NULL;
+	pthread_mutex_unlock(&bio.lock);
+
+	for(; req != NULL; req = next, n++){
+		next = req->next;
+		if(req->done != NULL) req->done(req);
+	}
+	return n;
+}
+
+/* Requests in flight, which the threads change under the lock */
+static int bio_inflight(void) {
+	int n;
+
+	pthread_mutex_lock(&bio.lock);
+	n = bio.inflight;
+	pthread_mutex_unlock(&bio.lock);
+	return n;
+}
+
+/* Waits until something is completed or nothing is in flight */
+static void bio_block(void) {
+	if(bio.engine == BIO_URING){
+		if(bio.inflight > 0 && *ring.cq_head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)){
+			uring_enter(0, 1);
+		}
+		return;
+	}
+	pthread_mutex_lock(&bio.lock);
+	while(bio.head == NULL && bio.inflight > 0){
+		pthread_cond_wait(&bio.done, &bio.lock);
+	}
+	pthread_mutex_unlock(&bio.lock);
+}
+
+int bio_submit(struct bio_req *reqs, int n) {
+	int i, queued = 0;
+
+	if(bio.engine == 0){
+		return -1;
+	}
+	for(i = 0; i < n; i++){
+		if(dev_prepare(reqs[i].first, reqs[i].count, reqs[i].writing) == -1){
+			break;
+		}
+		reqs[i].status = -1;
+
+		if(bio.engine == BIO_SYNC){
+			bio_complete(&reqs[i], dev_range(reqs[i].first, reqs[i].buffer, reqs[i].count, reqs[i].writing));
+			continue;
+		}
+
+		//Make room, sending what is queued so that it can complete
+		while(bio_inflight() >= bio.depth){
+			if(bio.engine == BIO_URING && queued > 0){
+				uring_enter(queued, 0);
+				queued = 0;
+			}
+			bio_block();
+			bio_deliver();
+		}
+
+		pthread_mutex_lock(&bio.lock);
+		bio.inflight++;
+		if(bio.engine == BIO_URING){
+			uring_queue(&reqs[i]);
+			queued++;
+		}
+		else{
+			reqs[i].next = NULL;
+			if(pool.tail != NULL) pool.tail->next = &reqs[i];
+			else pool.head = &reqs[i];
+			pool.tail = &reqs[i];
+			pthread_cond_signal(&bio.work);
+		}
+		pthread_mutex_unlock(&bio.lock);
+	}
+	if(queued > 0){
+		uring_enter(queued, 0);
+	}
+	return i == n ? 0 : -1;
+}
+
+int bio_poll(void) {
+	return bio.engine == 0 ? 0 : bio_deliver();
+}
+
+int bio_wait(int min) {
+	int n;
+
+	if(bio.engine == 0){
+		return 0;
+	}
+	n = bio_deliver();
+	while(n < min && bio_inflight() > 0){
+		bio_block();
+		n += bio_deliver();
+	}
+	return n;
+}
+
+int bio_exit(void) {
+	if(bio.engine == 0){
+		return -1;
+	}
+	while(bio_inflight() > 0){
+		bio_block();
+		bio_deliver();
+	}
+	bio_deliver();
+	if(bio.engine == BIO_URING) uring_exit();
+	if(bio.engine == BIO_THREADS) pool_exit();
+	bio.engine = 0;
+	return 0;
+}
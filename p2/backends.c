@@ -0,0 +1,322 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	backends.c
+ * @brief 	Backends of the device: positional I/O on the file, a mapping of it
+ * 			and devices that only live in memory.
+ * @date	01/03/2017
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "backend.h"
+#include "device.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024		// limit of Linux, not exported without _XOPEN_SOURCE
+#endif
+
+int fd_block(int fd, int blockNumber, char *buffer, int writing) {
+	off_t offset = (off_t) blockNumber * BLOCK_SIZE;
+	ssize_t done = 0, n;
+
+	while(done < BLOCK_SIZE){
+		if(writing){
+			n = pwrite(fd, buffer+done, BLOCK_SIZE-done, offset+done);
+		}
+		else{
+			n = pread(fd, buffer+done, BLOCK_SIZE-done, offset+done);
+		}
+		if(n < 0){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		if(n == 0){
+			return -1;	//The device is shorter than it was
+		}
+		done += n;
+	}
+	return 0;
+}
+
+int fd_blocks(int fd, int first, struct iovec *iov, int count, int writing) {
+	off_t offset = (off_t) first * BLOCK_SIZE;
+	ssize_t n;
+
+	while(count > 0){
+		if(writing){
+			n = pwritev(fd, iov, count < IOV_MAX ? count : IOV_MAX, offset);
+		}
+		else{
+			n = preadv(fd, iov, count < IOV_MAX ? count : IOV_MAX, offset);
+		}
+		if(n < 0){
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		if(n == 0){
+			return -1;
+		}
+		//Skip what was transferred, which may end in the middle of a block
+		offset += n;
+		while(count > 0 && n >= (ssize_t) iov->iov_len){
+			n -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if(count > 0){
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+/*********************/
+/* pread and pwrite. */
+/*********************/
+
+static int pread_fd = -1;
+
+static int pread_open(char *name, int fd, off_t size) {
+	pread_fd = fd;
+	return 0;
+}
+
+static int pread_block(int blockNumber, char *buffer, int writing) {
+	return fd_block(pread_fd, blockNumber, buffer, writing);
+}
+
+static int pread_blocks(int first, struct iovec *iov, int count, int writing) {
+	return fd_blocks(pread_fd, first, iov, count, writing);
+}
+
+static int pread_sync(void) {
+	return fsync(pread_fd);
+}
+
+static int pread_close(void) {
+	pread_fd = -1;
+	return 0;
+}
+
+struct backend pread_backend = {0, pread_open, pread_block, pread_blocks, pread_sync, pread_close};
+
+/*********/
+/* mmap. */
+/*********/
+
+/* The whole device is mapped shared, so the writes reach the file without a copy of ours */
+static char *map = NULL;
+static size_t map_size;
+
+static int mmap_open(char *name, int fd, off_t size) {
+	map_size = size;
+	if(map_size == 0){
+		return -1;
+	}
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(map == MAP_FAILED){
+		map = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static int mmap_block(int blockNumber, char *buffer, int writing) {
+	char *block = map + (size_t) blockNumber * BLOCK_SIZE;
+
+	if(writing){
+		memcpy(block, buffer, BLOCK_SIZE);
+	}
+	else{
+		memcpy(buffer, block, BLOCK_SIZE);
+	}
+	return 0;
+}
+
+static int mmap_sync(void) {
+	return msync(map, map_size, MS_SYNC);
+}
+
+static int mmap_close(void) {
+	int ret = mmap_sync();
+
+	if(munmap(map, map_size) == -1){
+		ret = -1;
+	}
+	map = NULL;
+	return ret;
+}
+
+struct backend mmap_backend = {1, mmap_open, mmap_block, NULL, mmap_sync, mmap_close};
+
+/********/
+/* RAM. */
+/********/
+
+#define RAM_DEVICES 8
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static struct ram {
+	char name[256];				// empty if the entry is not in use
+	char *data;
+	size_t size;				// size of the device
+	size_t mapped;				// size of the mapping, rounded to the page size
+	int open;					// 1 while the device is open
+} rams[RAM_DEVICES];
+
+static struct ram *ram_open_dev = NULL;
+
+static struct ram *ram_find(char *name) {
+	int i;
+
+	for(i = 0; i < RAM_DEVICES; i++){
+		if(rams[i].name[0] != '\0' && strcmp(rams[i].name, name) == 0){
+			return &rams[i];
+		}
+	}
+	return NULL;
+}
+
+off_t ram_size(char *name) {
+	struct ram *r = ram_find(name);
+
+	return r == NULL ? -1 : (off_t) r->size;
+}
+
+/* With RAM_HUGEPAGES the device takes reserved huge pages if there are any, or else asks for transparent ones */
+int ram_create(char *name, long size, int flags) {
+	struct ram *r = NULL;
+	int i;
+
+	if(size <= 0 || size % BLOCK_SIZE != 0 || strlen(name) == 0 || strlen(name) >= sizeof(r->name) || ram_find(name) != NULL){
+		return -1;
+	}
+	for(i = 0; i < RAM_DEVICES && r == NULL; i++){
+		if(rams[i].name[0] == '\0') r = &rams[i];
+	}
+	if(r == NULL){
+		return -1;
+	}
+
+	r->data = MAP_FAILED;
+	r->size = size;
+#ifdef MAP_HUGETLB
+	if(flags & RAM_HUGEPAGES){
+		r->mapped = (r->size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		r->data = mmap(NULL, r->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+#endif
+	if(r->data == MAP_FAILED){
+		r->mapped = r->size;
+		r->data = mmap(NULL, r->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(r->data == MAP_FAILED){
+			return -1;
+		}
+#ifdef MADV_HUGEPAGE
+		if(flags & RAM_HUGEPAGES){
+			madvise(r->data, r->mapped, MADV_HUGEPAGE);
+		}
+#endif
+	}
+	r->open = 0;
+	strcpy(r->name, name);
+	return 0;
+}
+
+int ram_destroy(char *name) {
+	struct ram *r = ram_find(name);
+
+	if(r == NULL || r->open){
+		return -1;
+	}
+	munmap(r->data, r->mapped);
+	r->name[0] = '\0';
+	return 0;
+}
+
+int ram_load(char *name, char *path, int flags) {
+	struct stat st;
+	struct ram *r;
+	ssize_t n;
+	size_t done = 0;
+	int fd;
+
+	if((fd = open(path, O_RDONLY)) < 0){
+		return -1;
+	}
+	if(fstat(fd, &st) == -1 || ram_create(name, st.st_size, flags) == -1){
+		close(fd);
+		return -1;
+	}
+	r = ram_find(name);
+	while(done < r->size){
+		n = read(fd, r->data + done, r->size - done);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0){
+			close(fd);
+			ram_destroy(name);
+			return -1;
+		}
+		done += n;
+	}
+	close(fd);
+	return 0;
+}
+
+int ram_snapshot(char *name, char *path) {
+	struct ram *r = ram_find(name);
+	ssize_t n;
+	size_t done = 0;
+	int fd;
+
+	if(r == NULL || (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0){
+		return -1;
+	}
+	while(done < r->size){
+		n = write(fd, r->data + done, r->size - done);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0){
+			close(fd);
+			return -1;
+		}
+		done += n;
+	}
+	return close(fd);
+}
+
+static int ram_open(char *name, int fd, off_t size) {
+	ram_open_dev = ram_find(name);
+	ram_open_dev->open = 1;
+	return 0;
+}
+
+static int ram_block(int blockNumber, char *buffer, int writing) {
+	char *block = ram_open_dev->data + (size_t) blockNumber * BLOCK_SIZE;
+
+	if(writing){
+		memcpy(block, buffer, BLOCK_SIZE);
+	}
+	else{
+		memcpy(buffer, block, BLOCK_SIZE);
+	}
+	return 0;
+}
+
+/* Nothing outlives the process: a RAM device is made durable with ram_snapshot() */
+static int ram_sync(void) {
+	return 0;
+}
+
+static int ram_close(void) {
+	ram_open_dev->open = 0;
+	ram_open_dev = NULL;
+	return 0;
+}
+
+struct backend ram_backend = {1, ram_open, ram_block, NULL, ram_sync, ram_close};
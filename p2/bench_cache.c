@@ -0,0 +1,243 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	bench_cache.c
+ * @brief 	Hit rate of the cache policies on traces of point reads and scans,
+ * 			cost of random I/O on each backend and on each async engine.
+ *
+ * Each trace is replayed with bread() on a scratch device, once per policy, with
+ * the same number of frames. A hot set of blocks is read at random and, in the
+ * mixed traces, long sequential scans of cold blocks come in between, as
+ * CRCheck(F_ID) or a checkFS sweep would.
+ *
+ * Usage: ./bench_cache [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blocks_cache.h"
+#include "device.h"
+#include "cache.h"
+#include "async.h"
+
+#define BENCH_DEVICE "bench.dat"
+#define BENCH_BLOCKS 8192			// 16 MiB of device
+#define BENCH_ACCESSES 200000
+
+static int *trace;
+static int ntrace;
+
+/* xorshift64*: the same traces on every run */
+static unsigned long long rng_state = 1;
+static unsigned long rng(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (rng_state * 2685821657736338717ULL) >> 33;
+}
+
+/*
+ * Fills the trace with rounds of <points> random reads of the first <hot>
+ * blocks, each followed by a scan of <scan> blocks. The scans go through the
+ * rest of the device, so they never read a block twice close together.
+ */
+static void make_trace(int hot, int points, int scan) {
+	int i, cold = hot;
+
+	ntrace = 0;
+	while(ntrace < BENCH_ACCESSES){
+		for(i = 0; i < points && ntrace < BENCH_ACCESSES; i++){
+			trace[ntrace++] = rng() % hot;
+		}
+		for(i = 0; i < scan && ntrace < BENCH_ACCESSES; i++){
+			trace[ntrace++] = cold;
+			cold = cold + 1 < BENCH_BLOCKS ? cold + 1 : hot;
+		}
+	}
+}
+
+/* Reads of a working set larger than the cache, in a loop */
+static void make_loop(int blocks) {
+	for(ntrace = 0; ntrace < BENCH_ACCESSES; ntrace++){
+		trace[ntrace] = ntrace % blocks;
+	}
+}
+
+static int run(const char *name, int frames) {
+	static const char *policies[] = {"LRU", "2Q"};
+	struct cache_stats st;
+	struct timespec t0, t1;
+	char buf[BLOCK_SIZE];
+	int p, i;
+
+	printf("%-24s", name);
+	for(p = CACHE_LRU; p <= CACHE_2Q; p++){
+		cache_frames(frames);
+		cache_policy(p);
+		if(dev_open(BENCH_DEVICE) == -1){
+			printf("[ERROR] Cannot open %s\n", BENCH_DEVICE);
+			return -1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for(i = 0; i < ntrace; i++){
+			if(bread(BENCH_DEVICE, trace[i], buf) == -1){
+				printf("[ERROR] Cannot read block %d\n", trace[i]);
+				dev_close();
+				return -1;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		cache_getstats(&st);
+		dev_close();
+		printf("  %s %5.1f%% %6.0f ns", policies[p], 100.0 * st.hits / (st.hits + st.misses),
+			((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ntrace);
+	}
+	printf("\n");
+	return 0;
+}
+
+/* Random reads and writes of single blocks over the whole device */
+static int run_backends(int frames) {
+	static const char *names[] = {"pread, no cache", "pread + cache", "mmap"};
+	static const int backend[] = {DEV_PREAD, DEV_PREAD, DEV_MMAP};
+	struct timespec t0, t1;
+	char buf[BLOCK_SIZE];
+	int b, i, writing;
+
+	memset(buf, 'x', BLOCK_SIZE);
+	make_trace(BENCH_BLOCKS, BENCH_ACCESSES, 0);
+	printf("\nrandom I/O over %d blocks, time per call\n", BENCH_BLOCKS);
+	for(b = 0; b < 3; b++){
+		dev_backend(backend[b]);
+		cache_frames(b == 0 ? 0 : frames);
+		printf("%-24s", names[b]);
+		for(writing = 0; writing <= 1; writing++){
+			if(dev_open(BENCH_DEVICE) == -1){
+				printf("[ERROR] Cannot open %s\n", BENCH_DEVICE);
+				return -1;
+			}
+			//The time of a write includes writing the cache back at the end
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			for(i = 0; i < ntrace; i++){
+				if((writing ? bwrite(BENCH_DEVICE, trace[i], buf) : bread(BENCH_DEVICE, trace[i], buf)) == -1){
+					printf("[ERROR] Cannot access block %d\n", trace[i]);
+					dev_close();
+					return -1;
+				}
+			}
+			cache_flush();
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			dev_close();
+			printf("  %s %6.0f ns", writing ? "bwrite" : "bread", ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / ntrace);
+		}
+		printf("\n");
+	}
+	dev_backend(DEV_PREAD);
+	return 0;
+}
+
+static struct bio_req *idle[32];
+static int nidle;
+
+static void async_done(struct bio_req *req) {
+	idle[nidle++] = req;
+}
+
+/* Random reads of single blocks kept depth at a time in flight */
+static int run_async(void) {
+	static const char *names[] = {"", "io_uring", "threads"};
+	static const int depths[] = {1, 8, 32};
+	struct timespec t0, t1;
+	struct bio_req *reqs;
+	char *bufs;
+	int e, d, i, n;
+
+	reqs = malloc(sizeof(struct bio_req) * 32);
+	bufs = malloc((size_t) 32 * BLOCK_SIZE);
+	make_trace(BENCH_BLOCKS, BENCH_ACCESSES / 4, 0);
+	n = BENCH_ACCESSES / 4;
+	printf("\nasync random reads, time per block\n");
+	for(e = BIO_URING; e <= BIO_THREADS; e++){
+		printf("%-24s", names[e]);
+		for(d = 0; d < 3; d++){
+			if(dev_open(BENCH_DEVICE) == -1 || bio_init(depths[d], e) != e){
+				printf("  depth %2d unavailable", depths[d]);
+				dev_close();
+				continue;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			//Each request is submitted again as soon as it completes, with the next block of the trace
+			for(i = 0; i < depths[d] && i < n; i++){
+				reqs[i].first = trace[i];
+				reqs[i].count = 1;
+				reqs[i].buffer = bufs + (size_t) i * BLOCK_SIZE;
+				reqs[i].writing = 0;
+				reqs[i].done = async_done;
+			}
+			nidle = 0;
+			bio_submit(reqs, i);
+			while(i < n){
+				bio_wait(1);
+				while(nidle > 0 && i < n){
+					idle[--nidle]->first = trace[i++];
+					bio_submit(idle[nidle], 1);
+				}
+			}
+			bio_exit();
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			dev_close();
+			printf("  depth %2d %5.0f ns", depths[d], ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n);
+		}
+		printf("\n");
+	}
+	free(reqs);
+	free(bufs);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 256, ret = 0;
+	char block[BLOCK_SIZE];
+	FILE *f;
+	int i;
+
+	if(frames <= 0){
+		printf("Syntax: ./bench_cache [frames]\n");
+		return -1;
+	}
+
+	if((f = fopen(BENCH_DEVICE, "w")) == NULL){
+		perror("[ERROR] Cannot create the device");
+		return -1;
+	}
+	memset(block, '0', BLOCK_SIZE);
+	for(i = 0; i < BENCH_BLOCKS; i++){
+		fwrite(block, BLOCK_SIZE, 1, f);
+	}
+	fclose(f);
+	trace = malloc(sizeof(int) * BENCH_ACCESSES);
+
+	printf("%d frames, %d accesses per trace, hit rate and time per bread()\n", frames, BENCH_ACCESSES);
+	make_trace(frames * 3 / 4, BENCH_ACCESSES, 0);
+	if(ret == 0 && run("point reads", frames) == -1) ret = -1;
+	make_trace(frames * 3 / 4, 0, BENCH_ACCESSES);
+	if(ret == 0 && run("scan", frames) == -1) ret = -1;
+	make_trace(frames * 3 / 4, 4 * frames, frames);
+	if(ret == 0 && run("points + short scans", frames) == -1) ret = -1;
+	make_trace(frames * 3 / 4, 4 * frames, 4 * frames);
+	if(ret == 0 && run("points + long scans", frames) == -1) ret = -1;
+	make_trace(frames / 2, frames, 2 * frames);
+	if(ret == 0 && run("metadata + file scans", frames) == -1) ret = -1;
+	make_loop(frames + frames / 4);
+	if(ret == 0 && run("loop over 1.25x frames", frames) == -1) ret = -1;
+	if(ret == 0 && run_backends(frames) == -1) ret = -1;
+	if(ret == 0 && run_async() == -1) ret = -1;
+
+	free(trace);
+	remove(BENCH_DEVICE);
+	return ret;
+}
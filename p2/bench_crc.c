@@ -0,0 +1,139 @@
+/*
+ * OPERATING SYSTEMS DESING - 17/18
+ *
+ * @file 	bench_crc.c
+ * @brief 	Throughput of CRC16(), CRC32() and CRC64() with each kernel and
+ * 			buffer size.
+ *
+ * Every kernel the CPU can run is first checked against the one that reads a
+ * byte at a time, and CRC32() against zlib, on buffers of many lengths and
+ * alignments. Then each buffer size is hashed again and again, for about the
+ * same number of bytes.
+ *
+ * Usage: ./bench_crc [MiB per test]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "crc.h"
+#include "crc_kernel.h"
+
+#define BENCH_MAX_BUFFER (1 << 20)
+#define BENCH_CHECKS 2000			// Random buffers checked per kernel
+
+static const char *kernels[] = {"", "byte", "slice-by-8", "hw"};
+static const char *algorithms[] = {"CRC16", "CRC32", "CRC64"};
+
+static unsigned char *data;
+static volatile uint64_t sink;		// Keeps the CRCs from being optimized away
+
+/* xorshift64*: the same data on every run */
+static unsigned long long rng_state = 1;
+static unsigned long rng(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return (rng_state * 2685821657736338717ULL) >> 33;
+}
+
+static uint64_t crc(int algorithm, const unsigned char *buffer, unsigned int length) {
+	switch(algorithm){
+		case 0: return CRC16(buffer, length, 0);
+		case 1: return CRC32(buffer, length, 0);
+		default: return CRC64(buffer, length);
+	}
+}
+
+/* Compares the kernel with CRC_BYTE on random slices of the data, and with the known check values */
+static int check(int kernel) {
+	static const unsigned char digits[] = "123456789";
+	uint64_t ref;
+	unsigned int off, len;
+	int a, i;
+
+	crc_kernel(kernel);
+	if(CRC16(digits, 9, 0) != 0x31C3 || CRC32(digits, 9, 0) != 0xCBF43926 || CRC64(digits, 9) != 0x995DC9BBDF1939FAULL){
+		printf("[ERROR] Wrong check value with the %s kernel\n", kernels[kernel]);
+		return -1;
+	}
+	for(i = 0; i < BENCH_CHECKS; i++){
+		len = rng() % (i < BENCH_CHECKS / 2 ? 1024 : 65536);
+		off = rng() % 64;
+		for(a = 0; a < 3; a++){
+			crc_kernel(CRC_BYTE);
+			ref = a == 1 ? crc32(0, data + off, len) : crc(a, data + off, len);
+			crc_kernel(kernel);
+			if(crc(a, data + off, len) != ref){
+				printf("[ERROR] %s of %u bytes at %u differs with the %s kernel\n", algorithms[a], len, off, kernels[kernel]);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void run(int kernel, long bytes) {
+	static const unsigned int sizes[] = {64, 512, 2048, 65536, BENCH_MAX_BUFFER};
+	struct timespec t0, t1;
+	long i, n;
+	int a, s;
+
+	crc_kernel(kernel);
+	printf("\n%s kernel, GB/s\n%10s", kernels[kernel], "buffer");
+	for(a = 0; a < 3; a++){
+		printf(" %10s", algorithms[a]);
+	}
+	printf("\n");
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+		n = (bytes + sizes[s] - 1) / sizes[s];
+		printf("%10u", sizes[s]);
+		for(a = 0; a < 3; a++){
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			for(i = 0; i < n; i++){
+				sink ^= crc(a, data, sizes[s]);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			printf(" %10.2f", (double) n * sizes[s] / ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)));
+		}
+		printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	long bytes = (argc > 1 ? atol(argv[1]) : 256) << 20;
+	int k, i;
+
+	if(bytes <= 0){
+		printf("Syntax: ./bench_crc [MiB per test]\n");
+		return -1;
+	}
+	data = malloc(BENCH_MAX_BUFFER + 64);
+	for(i = 0; i < BENCH_MAX_BUFFER + 64; i++){
+		data[i] = rng();
+	}
+
+	for(k = CRC_BYTE; k <= CRC_HW; k++){
+		if(crc_kernel(k) == -1){
+			printf("%s kernel: not available on this CPU\n", kernels[k]);
+			continue;
+		}
+		if(check(k) == -1){
+			free(data);
+			return -1;
+		}
+		printf("%s kernel: results match\n", kernels[k]);
+	}
+	for(k = CRC_BYTE; k <= CRC_HW; k++){
+		if(crc_kernel(k) != -1){
+			run(k, k == CRC_BYTE ? bytes / 4 : bytes);
+		}
+	}
+
+	free(data);
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	bench_file.c
+ * @brief 	Throughput of sequential writeFile() and readFile() for several
+ * 			request sizes.
+ *
+ * The file system is made on a RAM device called DEVICE_IMAGE, so disk.dat is
+ * not touched and the time is the one of the file system and the cache. One
+ * file of up to BENCH_MAX_FILE bytes, or as many as fit, is written and read
+ * from the start to the end, again and again, with requests of each size, once
+ * for each layout of the files. Then a sparse file is written with each layout.
+ *
+ * Usage: ./bench_file [MiB per test]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "filesystem.h"
+#include "device.h"
+#include "layout.h"
+
+#define BENCH_DEV_SIZE 10485760		// Large enough for a file of BENCH_MAX_FILE bytes
+#define BENCH_MAX_FILE (8 << 20)	// Enough for the file to reach its limit
+#define BENCH_SPARSE 1000			// Blocks written to the sparse file
+#define BENCH_STRIDE (1 << 22)		// Bytes from a block of the sparse file to the next
+
+static char *data;
+static int file_size;
+
+/* Writes or reads the whole file, from the start, with requests of size bytes */
+static int pass(int fd, int size, int writing) {
+	int done, n;
+
+	if(lseekFile(fd, 0, FS_SEEK_BEGIN) == -1){
+		return -1;
+	}
+	for(done = 0; done < file_size; done += n){
+		n = file_size - done < size ? file_size - done : size;
+		if((writing ? writeFile(fd, data + done, n) : readFile(fd, data + done, n)) != n){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Sequential writes and reads of the file, with each request size, on a new file system */
+static int run(int layout, long bytes) {
+	static const int sizes[] = {64, 512, 2048, 8192, 65536, 1048576};
+	struct timespec t0, t1;
+	int fd, s, writing, passes, i;
+
+	fs_layout(layout);
+	if(mkFS(BENCH_DEV_SIZE) == -1 || mountFS() == -1){
+		printf("[ERROR] Cannot make the file system\n");
+		return -1;
+	}
+	if(createFile("bench") == -1 || (fd = openFile("bench")) < 0){
+		printf("[ERROR] Cannot create the file\n");
+		unmountFS();
+		return -1;
+	}
+
+	//The first write tells how large the file can be
+	if((file_size = writeFile(fd, data, BENCH_MAX_FILE)) <= 0){
+		printf("[ERROR] Cannot write the file\n");
+		unmountFS();
+		return -1;
+	}
+	passes = (bytes + file_size - 1) / file_size;
+	printf("\n%s, file of %d bytes, %ld MiB per test\n", layout == LAYOUT_EXTENTS ? "extents" : "indirect", file_size, bytes >> 20);
+	printf("%10s %12s %12s\n", "request", "write MB/s", "read MB/s");
+
+	for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+		if(s > 0 && sizes[s - 1] >= file_size){
+			break;
+		}
+		printf("%10d", sizes[s]);
+		for(writing = 1; writing >= 0; writing--){
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			for(i = 0; i < passes; i++){
+				if(pass(fd, sizes[s], writing) == -1){
+					printf("\n[ERROR] Cannot %s the file\n", writing ? "write" : "read");
+					unmountFS();
+					return -1;
+				}
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			printf(" %12.1f", (double) passes * file_size / ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) * 1e3);
+		}
+		printf("\n");
+	}
+
+	closeFile(fd);
+	return unmountFS();
+}
+
+/*
+ * One block written every BENCH_STRIDE bytes of a file: with LAYOUT_INDIRECT
+ * the file grows far past the size of the device, with LAYOUT_EXTENTS the
+ * blocks in between fill the device.
+ */
+static int run_sparse(int layout) {
+	struct timespec t0, t1;
+	int fd, i, n;
+
+	fs_layout(layout);
+	if(mkFS(BENCH_DEV_SIZE) == -1 || mountFS() == -1){
+		printf("[ERROR] Cannot make the file system\n");
+		return -1;
+	}
+	if(createFile("sparse") == -1 || (fd = openFile("sparse")) < 0){
+		printf("[ERROR] Cannot create the file\n");
+		unmountFS();
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(i = 0; i < BENCH_SPARSE; i++){
+		if(lseekFile(fd, BENCH_STRIDE - BLOCK_SIZE, FS_SEEK_CUR) == -1 || (n = writeFile(fd, data, BLOCK_SIZE)) != BLOCK_SIZE){
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("%-10s %6d blocks written, file of %5ld MiB, %8.1f us per block\n", layout == LAYOUT_EXTENTS ? "extents" : "indirect",
+		i, (long) i * BENCH_STRIDE >> 20, ((t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3) / (i > 0 ? i : 1));
+	closeFile(fd);
+	return unmountFS();
+}
+
+int main(int argc, char *argv[])
+{
+	long bytes = (argc > 1 ? atol(argv[1]) : 64) << 20;
+	int ret = 0;
+
+	if(bytes <= 0){
+		printf("Syntax: ./bench_file [MiB per test]\n");
+		return -1;
+	}
+	if(ram_create(DEVICE_IMAGE, BENCH_DEV_SIZE, RAM_HUGEPAGES) == -1){
+		printf("[ERROR] Cannot create the device\n");
+		return -1;
+	}
+	data = malloc(BENCH_MAX_FILE);
+	memset(data, 'x', BENCH_MAX_FILE);
+
+	if(ret == 0 && run(LAYOUT_EXTENTS, bytes) == -1) ret = -1;
+	if(ret == 0 && run(LAYOUT_INDIRECT, bytes) == -1) ret = -1;
+	printf("\nsparse file, a block every %d MiB\n", BENCH_STRIDE >> 20);
+	if(ret == 0 && run_sparse(LAYOUT_EXTENTS) == -1) ret = -1;
+	if(ret == 0 && run_sparse(LAYOUT_INDIRECT) == -1) ret = -1;
+
+	free(data);
+	ram_destroy(DEVICE_IMAGE);
+	return ret;
+}
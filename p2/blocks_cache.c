@@ -5,75 +5,751 @@
  * order to read or read to and from the device.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
 #include "blocks_cache.h"
+#include "device.h"
+#include "cache.h"
+#include "backend.h"
 
-/****************/
-/* Disk access. */
-/****************/
+static struct backend *backends[] = {&pread_backend, &mmap_backend};
+
+/* Device opened by dev_open(), backend is NULL when there is none */
+static struct {
+	int fd;						// -1 for a RAM device
+	char name[256];
+	off_t size;
+	int nbackend;				// backend for the next dev_open()
+	struct backend *backend;
+} dev = {-1, "", 0, DEV_PREAD, NULL};
+
+/* A frame of the cache holds one block of the device */
+struct frame {
+	int block;					// -1 while the frame is free
+	int dirty;					// 1 if the device has an older copy
+	struct frame *hnext;		// next frame in the same hash bucket
+	struct frame *prev, *next;	// list of the frame, most recently used first
+	struct flist *list;			// list the frame is in
+	char *data;
+};
+
+struct flist {
+	struct frame *head, *tail;
+	int n;
+};
+
+/* Block recently replaced from a1in, without its data */
+struct ghost {
+	int block;					// -1 if the entry is not in use
+	struct ghost *hnext;
+};
 
 /*
- * Reads a block from the device and stores it in a buffer.
- * Returns 0 or -1 in case of error, including short
- * read.
+ * Cache of the open device, allocated by dev_open(). With CACHE_LRU every frame
+ * is in am. With CACHE_2Q a block enters a1in, a FIFO that is replaced first
+ * once it has more than a quarter of the cache, and moves to am, the LRU of the
+ * hot blocks, when it is used again: while it is in a1in or while its number is
+ * still among the ghosts. A scan then goes through a1in and does not replace
+ * the blocks in am.
  */
-int bread(char *deviceName, int blockNumber, char *buffer) {
-	int fd = open(deviceName, O_RDONLY);
+static struct {
+	int nframes, npolicy;		// frames and policy for the next dev_open()
+	int size;					// frames allocated, 0 if the cache is off
+	int policy;
+	unsigned int mask;			// number of buckets - 1
+	struct frame *frames, **buckets, **order;
+	struct bvec *vec;			// segments of a flush, one per frame in order
+	int *idx;
+	struct flist am, a1in;
+	struct frame *free;			// frames not in use, linked by next
+	char *data;
+	int kin, kout;				// 2Q: target size of a1in, number of ghosts
+	struct ghost *ghosts, **gbuckets;
+	int gnext;					// oldest ghost, the next one replaced
+	struct cache_stats stats;
+} cache = {CACHE_FRAMES, CACHE_2Q};
 
-	if(fd < 0){
-		/* fprintf(stderr, "ERROR: UNABLE TO OPEN DISK FILE %s \n", deviceName); */
+static int cache_open(void);
+static void cache_close(void);
+
+/******************/
+/* Device handle. */
+/******************/
+
+int dev_open(char *deviceName) {
+	struct backend *backend;
+	struct stat st;
+	off_t size;
+	int fd = -1;
+
+	if(dev.backend != NULL){
+		return strcmp(dev.name, deviceName) == 0 ? 0 : -1;
+	}
+	if(strlen(deviceName) >= sizeof(dev.name)){
+		return -1;
+	}
+
+	//A RAM device hides the file with the same name
+	if((size = ram_size(deviceName)) >= 0){
+		backend = &ram_backend;
+	}
+	else{
+		fd = open(deviceName, O_RDWR);
+		if(fd < 0){
+			/* fprintf(stderr, "ERROR: UNABLE TO OPEN DISK FILE %s \n", deviceName); */
+			return -1;
+		}
+		if(fstat(fd, &st) == -1){
+			close(fd);
+			return -1;
+		}
+		size = st.st_size;
+		backend = backends[dev.nbackend];
+	}
+
+	if(backend->open(deviceName, fd, size) == -1){
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+	dev.backend = backend;
+	dev.fd = fd;
+	dev.size = size;
+	strcpy(dev.name, deviceName);
+	if(cache_open() == -1){
+		dev_close();
+		return -1;
+	}
+	return 0;
+}
+
+int dev_close(void) {
+	int ret;
+
+	if(dev.backend == NULL){
 		return -1;
 	}
+	ret = cache_flush();
+	cache_close();
+	if(dev.backend->close() == -1){
+		ret = -1;
+	}
+	if(dev.fd >= 0 && close(dev.fd) == -1){
+		ret = -1;
+	}
+	dev.backend = NULL;
+	dev.fd = -1;
+	dev.name[0] = '\0';
+	return ret;
+}
 
-	int len = lseek(fd, 0, SEEK_END) + 1;
-	if((BLOCK_SIZE*blockNumber+BLOCK_SIZE) > len) {
-		close(fd);
+int dev_backend(int backend) {
+	if(backend != DEV_PREAD && backend != DEV_MMAP){
 		return -1;
 	}
+	dev.nbackend = backend;
+	return 0;
+}
 
-	lseek(fd, BLOCK_SIZE*blockNumber, SEEK_SET);
+int dev_sync(void) {
+	int ret;
 
-	int total_read, read_result;
+	if(dev.backend == NULL){
+		return -1;
+	}
+	ret = cache_flush();
+	if(dev.backend->sync() == -1){
+		ret = -1;
+	}
+	return ret;
+}
 
-	total_read = 0;
-	do{
-		read_result = read(fd, buffer+total_read, BLOCK_SIZE-total_read);
-		total_read = total_read + read_result;
-	} while(total_read < BLOCK_SIZE && read_result >= 0);
+long dev_size(void) {
+	return dev.backend == NULL ? -1 : (long) dev.size;
+}
 
-	close(fd);
+/* Transfers one whole block of the open device. Blocks past its end are an error */
+static int dev_block(int blockNumber, char *buffer, int writing) {
+	if(blockNumber < 0 || (off_t) (blockNumber + 1) * BLOCK_SIZE > dev.size) {
+		return -1;
+	}
+	return dev.backend->block(blockNumber, buffer, writing);
+}
 
+/* Transfers count consecutive blocks from first, checked by the caller */
+static int dev_run(int first, struct iovec *iov, int count, int writing) {
+	int i;
+
+	if(dev.backend->blocks != NULL){
+		return dev.backend->blocks(first, iov, count, writing);
+	}
+	for(i = 0; i < count; i++){
+		if(dev.backend->block(first + i, iov[i].iov_base, writing) == -1){
+			return -1;
+		}
+	}
 	return 0;
 }
 
 /*
- * Writes a block from a buffer to the device.
- * Returns 0 or -1 in case of error.
+ * Transfers the segments vec[idx[0..n)], which are sorted by block and have
+ * different blocks inside the device. Consecutive blocks go in a single call
+ * to the backend. If that call fails its blocks are retried one by one, so that
+ * the status of each segment is exact.
  */
-int bwrite(char *deviceName, int blockNumber, char*buffer) {
-	int fd = open(deviceName, O_WRONLY);
+static int dev_segments(struct bvec *vec, int *idx, int n, int writing) {
+	struct iovec *iov;
+	int i, j, k, ret = 0;
 
-	if(fd < 0){
-		/* fprintf(stderr, "ERROR: UNABLE TO OPEN DISK FILE %s \n", deviceName); */
+	if(n == 0){
+		return 0;
+	}
+	if((iov = malloc(sizeof(struct iovec) * n)) == NULL){
+		for(k = 0; k < n; k++) vec[idx[k]].status = -1;
+		return -1;
+	}
+	for(i = 0; i < n; i = j){
+		for(j = i + 1; j < n && vec[idx[j]].block == vec[idx[j-1]].block + 1; j++);
+		for(k = i; k < j; k++){
+			iov[k-i].iov_base = vec[idx[k]].buffer;
+			iov[k-i].iov_len = BLOCK_SIZE;
+		}
+		if(dev_run(vec[idx[i]].block, iov, j - i, writing) == 0){
+			for(k = i; k < j; k++) vec[idx[k]].status = 0;
+			continue;
+		}
+		for(k = i; k < j; k++){
+			if((vec[idx[k]].status = dev_block(vec[idx[k]].block, vec[idx[k]].buffer, writing)) == -1){
+				ret = -1;
+			}
+		}
+	}
+	free(iov);
+	return ret;
+}
+
+/****************/
+/* Block cache. */
+/****************/
+
+int cache_frames(int frames) {
+	if(frames < 0){
 		return -1;
 	}
+	cache.nframes = frames;
+	return 0;
+}
 
-	int len = lseek(fd, 0, SEEK_END) + 1;
-	if((BLOCK_SIZE*blockNumber+BLOCK_SIZE) > len) {
-		close(fd);
+int cache_policy(int policy) {
+	if(policy != CACHE_LRU && policy != CACHE_2Q){
 		return -1;
 	}
+	cache.npolicy = policy;
+	return 0;
+}
+
+void cache_getstats(struct cache_stats *stats) {
+	*stats = cache.stats;
+}
+
+static int cache_open(void) {
+	int i;
+
+	memset(&cache.stats, 0, sizeof(cache.stats));
+	memset(&cache.am, 0, sizeof(cache.am));
+	memset(&cache.a1in, 0, sizeof(cache.a1in));
+	cache.size = 0;
+	cache.free = NULL;
+	if(cache.nframes == 0 || dev.backend->memory){
+		return 0;
+	}
+
+	cache.policy = cache.npolicy;
+	cache.kin = cache.nframes / 4 > 0 ? cache.nframes / 4 : 1;
+	cache.kout = cache.policy == CACHE_2Q ? cache.nframes / 2 : 0;
+	cache.gnext = 0;
+
+	for(cache.mask = 1; cache.mask < cache.nframes; cache.mask <<= 1);
+	cache.frames = malloc(sizeof(struct frame) * cache.nframes);
+	cache.buckets = calloc(cache.mask, sizeof(struct frame *));
+	cache.order = malloc(sizeof(struct frame *) * cache.nframes);
+	cache.vec = malloc(sizeof(struct bvec) * cache.nframes);
+	cache.idx = malloc(sizeof(int) * cache.nframes);
+	cache.data = malloc((size_t) cache.nframes * BLOCK_SIZE);
+	cache.ghosts = malloc(sizeof(struct ghost) * (cache.kout + 1));
+	cache.gbuckets = calloc(cache.mask, sizeof(struct ghost *));
+	cache.mask--;
+	if(cache.frames == NULL || cache.buckets == NULL || cache.order == NULL || cache.data == NULL
+		|| cache.vec == NULL || cache.idx == NULL || cache.ghosts == NULL || cache.gbuckets == NULL){
+		cache_close();
+		return -1;
+	}
+	for(i = 0; i < cache.kout; i++){
+		cache.ghosts[i].block = -1;
+	}
+
+	for(i = 0; i < cache.nframes; i++){
+		cache.frames[i].block = -1;
+		cache.frames[i].data = cache.data + (size_t) i * BLOCK_SIZE;
+		cache.frames[i].next = cache.free;
+		cache.free = &cache.frames[i];
+	}
+	cache.size = cache.nframes;
+	return 0;
+}
+
+static void cache_close(void) {
+	free(cache.frames);
+	free(cache.buckets);
+	free(cache.order);
+	free(cache.vec);
+	free(cache.idx);
+	free(cache.data);
+	free(cache.ghosts);
+	free(cache.gbuckets);
+	cache.frames = NULL;
+	cache.buckets = cache.order = NULL;
+	cache.vec = NULL;
+	cache.idx = NULL;
+	cache.data = NULL;
+	cache.ghosts = NULL;
+	cache.gbuckets = NULL;
+	cache.size = 0;
+}
+
+static struct frame **cache_bucket(int block) {
+	return &cache.buckets[(unsigned int) block & cache.mask];
+}
+
+static struct frame *cache_lookup(int block) {
+	struct frame *f;
+
+	for(f = *cache_bucket(block); f != NULL && f->block != block; f = f->hnext);
+	return f;
+}
+
+static void list_remove(struct frame *f) {
+	struct flist *l = f->list;
+
+	if(f->prev != NULL) f->prev->next = f->next;
+	else l->head = f->next;
+	if(f->next != NULL) f->next->prev = f->prev;
+	else l->tail = f->prev;
+	l->n--;
+}
+
+static void list_front(struct flist *l, struct frame *f) {
+	f->list = l;
+	f->prev = NULL;
+	f->next = l->head;
+	if(l->head != NULL) l->head->prev = f;
+	else l->tail = f;
+	l->head = f;
+	l->n++;
+}
+
+/* Remembers the number of a block replaced from a1in, forgetting the oldest one */
+static void ghost_add(int block) {
+	struct ghost *g, **p;
+
+	if(cache.kout == 0){
+		return;
+	}
+	g = &cache.ghosts[cache.gnext];
+	cache.gnext = (cache.gnext + 1) % cache.kout;
+	if(g->block >= 0){
+		for(p = &cache.gbuckets[(unsigned int) g->block & cache.mask]; *p != g; p = &(*p)->hnext);
+		*p = g->hnext;
+	}
+	g->block = block;
+	p = &cache.gbuckets[(unsigned int) block & cache.mask];
+	g->hnext = *p;
+	*p = g;
+}
 
-	lseek(fd, BLOCK_SIZE*blockNumber, SEEK_SET);
+/* Returns 1 and forgets block if it is a ghost, 0 otherwise */
+static int ghost_take(int block) {
+	struct ghost *g, **p;
 
-	int total_write, write_result;
+	if(cache.kout == 0){
+		return 0;
+	}
+	for(p = &cache.gbuckets[(unsigned int) block & cache.mask]; *p != NULL && (*p)->block != block; p = &(*p)->hnext);
+	if((g = *p) == NULL){
+		return 0;
+	}
+	*p = g->hnext;
+	g->block = -1;
+	return 1;
+}
+
+/*
+ * Returns a frame for block, taken from the free ones or by replacing the
+ * block the policy chooses. NULL if the replaced block can not be written.
+ */
+static struct frame *cache_frame(int block) {
+	struct frame *f, **p;
 
-	total_write = 0;
-	do{
-		write_result = write(fd, buffer+total_write, BLOCK_SIZE-total_write);
-		total_write = total_write + write_result;
-	} while(total_write < BLOCK_SIZE && write_result >= 0);
+	if(cache.free != NULL){
+		f = cache.free;
+		cache.free = f->next;
+	}
+	else{
+		if(cache.policy == CACHE_2Q && (cache.a1in.n > cache.kin || cache.am.n == 0)){
+			f = cache.a1in.tail;
+		}
+		else{
+			f = cache.am.tail;
+		}
+		if(f->dirty){
+			if(dev_block(f->block, f->data, 1) == -1){
+				return NULL;
+			}
+			cache.stats.writebacks++;
+		}
+		for(p = cache_bucket(f->block); *p != f; p = &(*p)->hnext);
+		*p = f->hnext;
+		if(f->list == &cache.a1in){
+			ghost_add(f->block);
+		}
+		list_remove(f);
+		cache.stats.evictions++;
+	}
+
+	f->block = block;
+	f->dirty = 0;
+	p = cache_bucket(block);
+	f->hnext = *p;
+	*p = f;
+	if(cache.policy == CACHE_2Q && !ghost_take(block)){
+		list_front(&cache.a1in, f);
+	}
+	else{
+		list_front(&cache.am, f);
+	}
+	return f;
+}
 
+/* Gives back a frame that cache_frame() returned and could not be filled */
+static void cache_drop(struct frame *f) {
+	struct frame **p;
+
+	for(p = cache_bucket(f->block); *p != f; p = &(*p)->hnext);
+	*p = f->hnext;
+	list_remove(f);
+	f->block = -1;
+	f->next = cache.free;
+	cache.free = f;
+}
+
+static int cache_block(int blockNumber, char *buffer, int writing) {
+	struct frame *f;
+
+	if(blockNumber < 0 || (off_t) (blockNumber + 1) * BLOCK_SIZE > dev.size){
+		return -1;
+	}
+
+	if((f = cache_lookup(blockNumber)) != NULL){
+		cache.stats.hits++;
+		list_remove(f);
+		list_front(&cache.am, f);
+	}
+	else{
+		cache.stats.misses++;
+		if((f = cache_frame(blockNumber)) == NULL){
+			return -1;
+		}
+		//A write replaces the whole block, there is no need to read it
+		if(!writing && dev_block(blockNumber, f->data, 0) == -1){
+			cache_drop(f);
+			return -1;
+		}
+	}
+
+	if(writing){
+		memcpy(f->data, buffer, BLOCK_SIZE);
+		f->dirty = 1;
+	}
+	else{
+		memcpy(buffer, f->data, BLOCK_SIZE);
+	}
+	return 0;
+}
+
+static int cmp_frame(const void *a, const void *b) {
+	return (*(struct frame * const *) a)->block - (*(struct frame * const *) b)->block;
+}
+
+/* Dirty blocks are written in increasing order, consecutive ones in a single call */
+int cache_flush(void) {
+	int i, n = 0, ret;
+
+	if(dev.backend == NULL){
+		return -1;
+	}
+	for(i = 0; i < cache.size; i++){
+		if(cache.frames[i].block >= 0 && cache.frames[i].dirty){
+			cache.order[n++] = &cache.frames[i];
+		}
+	}
+	if(n == 0){
+		return 0;
+	}
+	qsort(cache.order, n, sizeof(struct frame *), cmp_frame);
+	for(i = 0; i < n; i++){
+		cache.vec[i].block = cache.order[i]->block;
+		cache.vec[i].buffer = cache.order[i]->data;
+		cache.idx[i] = i;
+	}
+	ret = dev_segments(cache.vec, cache.idx, n, 1);
+	for(i = 0; i < n; i++){
+		if(cache.vec[i].status == 0){
+			cache.order[i]->dirty = 0;
+			cache.stats.writebacks++;
+		}
+	}
+	return ret;
+}
+
+/*
+ * Runs one transfer on the open device, through the cache if it is on, or, if
+ * it is another device, opening it just for this block.
+ */
+static int dev_access(char *deviceName, int blockNumber, char *buffer, int writing) {
+	struct stat st;
+	int fd, ret;
+
+	if(dev.backend != NULL && strcmp(dev.name, deviceName) == 0){
+		if(cache.size > 0){
+			return cache_block(blockNumber, buffer, writing);
+		}
+		return dev_block(blockNumber, buffer, writing);
+	}
+
+	fd = open(deviceName, writing ? O_WRONLY : O_RDONLY);
+	if(fd < 0){
+		return -1;
+	}
+	if(fstat(fd, &st) == -1 || blockNumber < 0 || (off_t) (blockNumber + 1) * BLOCK_SIZE > st.st_size){
+		ret = -1;
+	}
+	else{
+		ret = fd_block(fd, blockNumber, buffer, writing);
+	}
 	close(fd);
+	return ret;
+}
+
+/*******************************/
+/* Transfers around the cache. */
+/*******************************/
+
+int dev_fd(void) {
+	return dev.backend == NULL ? -1 : dev.fd;
+}
+
+int dev_prepare(int first, int count, int writing) {
+	struct frame *f;
+	int b;
 
+	if(dev.backend == NULL || first < 0 || count <= 0 || (off_t) first + count > dev.size / BLOCK_SIZE){
+		return -1;
+	}
+	for(b = first; cache.size > 0 && b < first + count; b++){
+		if((f = cache_lookup(b)) == NULL){
+			continue;
+		}
+		if(writing){
+			cache_drop(f);		//The transfer replaces it
+		}
+		else if(f->dirty){
+			if(dev_block(b, f->data, 1) == -1){
+				return -1;
+			}
+			f->dirty = 0;
+			cache.stats.writebacks++;
+		}
+	}
 	return 0;
 }
+
+int dev_range(int first, char *buffer, int count, int writing) {
+	int i;
+
+	for(i = 0; i < count; i++){
+		if(dev.backend->block(first + i, buffer + (size_t) i * BLOCK_SIZE, writing) == -1){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/********************/
+/* Vectored access. */
+/********************/
+
+static struct bvec *sort_vec;
+
+/* By block and, for the same block, in the order of the call */
+static int cmp_segment(const void *a, const void *b) {
+	int x = *(const int *) a, y = *(const int *) b;
+
+	if(sort_vec[x].block != sort_vec[y].block){
+		return sort_vec[x].block < sort_vec[y].block ? -1 : 1;
+	}
+	return x - y;
+}
+
+/*
+ * Reads of the open device. Hits are copied from the cache and the rest are
+ * read straight into the buffers of the caller, merged, and then put in the
+ * cache. A block asked twice is read once. idx has room for 3 * count.
+ */
+static int dev_readv(struct bvec *vec, int *idx, int count) {
+	struct frame *f;
+	int *dup = idx + count;		// pairs of segment and the first one with its block
+	int i, n = 0, m = 0, d = 0, ret = 0;
+
+	for(i = 0; i < count; i++){
+		if(vec[i].block < 0 || (off_t) (vec[i].block + 1) * BLOCK_SIZE > dev.size){
+			vec[i].status = ret = -1;
+		}
+		else if(cache.size > 0 && (f = cache_lookup(vec[i].block)) != NULL){
+			cache.stats.hits++;
+			list_remove(f);
+			list_front(&cache.am, f);
+			memcpy(vec[i].buffer, f->data, BLOCK_SIZE);
+			vec[i].status = 0;
+		}
+		else{
+			idx[n++] = i;
+		}
+	}
+
+	sort_vec = vec;
+	qsort(idx, n, sizeof(int), cmp_segment);
+	for(i = 0; i < n; i++){
+		if(m > 0 && vec[idx[i]].block == vec[idx[m-1]].block){
+			dup[d++] = idx[i];
+			dup[d++] = idx[m-1];
+		}
+		else{
+			idx[m++] = idx[i];
+		}
+	}
+	if(dev_segments(vec, idx, m, 0) == -1){
+		ret = -1;
+	}
+
+	for(i = 0; i < m; i++){
+		if(cache.size > 0 && vec[idx[i]].status == 0){
+			cache.stats.misses++;
+			if((f = cache_frame(vec[idx[i]].block)) != NULL){
+				memcpy(f->data, vec[idx[i]].buffer, BLOCK_SIZE);
+			}
+		}
+	}
+	for(i = 0; i < d; i += 2){
+		if((vec[dup[i]].status = vec[dup[i+1]].status) == 0){
+			memcpy(vec[dup[i]].buffer, vec[dup[i+1]].buffer, BLOCK_SIZE);
+		}
+	}
+	return ret;
+}
+
+/*
+ * Writes of the open device. Blocks in the cache are updated there and the
+ * rest go around it, merged, so that long writes do not replace the cache.
+ * If a block is written twice the last one wins.
+ */
+static int dev_writev(struct bvec *vec, int *idx, int count) {
+	struct frame *f;
+	int i, n = 0, m = 0, ret = 0;
+
+	for(i = 0; i < count; i++){
+		if(vec[i].block < 0 || (off_t) (vec[i].block + 1) * BLOCK_SIZE > dev.size){
+			vec[i].status = ret = -1;
+		}
+		else if(cache.size > 0 && (f = cache_lookup(vec[i].block)) != NULL){
+			cache.stats.hits++;
+			list_remove(f);
+			list_front(&cache.am, f);
+			memcpy(f->data, vec[i].buffer, BLOCK_SIZE);
+			f->dirty = 1;
+			vec[i].status = 0;
+		}
+		else{
+			idx[n++] = i;
+		}
+	}
+
+	sort_vec = vec;
+	qsort(idx, n, sizeof(int), cmp_segment);
+	for(i = 0; i < n; i++){
+		if(i + 1 < n && vec[idx[i+1]].block == vec[idx[i]].block){
+			vec[idx[i]].status = 0;		//Overwritten by a later segment
+		}
+		else{
+			idx[m++] = idx[i];
+		}
+	}
+	cache.stats.misses += m;
+	if(dev_segments(vec, idx, m, 1) == -1){
+		ret = -1;
+	}
+	return ret;
+}
+
+/* Runs a vectored transfer on the open device or, if it is another one, block by block */
+static int dev_accessv(char *deviceName, struct bvec *vec, int count, int writing) {
+	int *idx, i, ret = 0;
+
+	if(count <= 0){
+		return count == 0 ? 0 : -1;
+	}
+	if(dev.backend == NULL || strcmp(dev.name, deviceName) != 0){
+		for(i = 0; i < count; i++){
+			if((vec[i].status = dev_access(deviceName, vec[i].block, vec[i].buffer, writing)) == -1){
+				ret = -1;
+			}
+		}
+		return ret;
+	}
+
+	if((idx = malloc(sizeof(int) * 3 * count)) == NULL){
+		return -1;
+	}
+	ret = writing ? dev_writev(vec, idx, count) : dev_readv(vec, idx, count);
+	free(idx);
+	return ret;
+}
+
+/****************/
+/* Disk access. */
+/****************/
+
+/*
+ * Reads a block from the device and stores it in a buffer.
+ * Returns 0 or -1 in case of error, including short
+ * read.
+ */
+int bread(char *deviceName, int blockNumber, char *buffer) {
+	return dev_access(deviceName, blockNumber, buffer, 0);
+}
+
+/*
+ * Writes a block from a buffer to the device.
+ * Returns 0 or -1 in case of error.
+ */
+int bwrite(char *deviceName, int blockNumber, char*buffer) {
+	return dev_access(deviceName, blockNumber, buffer, 1);
+}
+
+int breadv(char *deviceName, struct bvec *vec, int count) {
+	return dev_accessv(deviceName, vec, count, 0);
+}
+
+int bwritev(char *deviceName, struct bvec *vec, int count) {
+	return dev_accessv(deviceName, vec, count, 1);
+}
@@ -5,13 +5,35 @@
  * @brief 	Implementation of the CRC functionality.
  * @date	04/03/2018
  *
- * DO NOT MODIFY
+ * DO NOT MODIFY the interface of crc.h, nor the results: CRC16(), CRC32() and
+ * CRC64() give the same values as the code this file was given with, which
+ * are stored on disk. Only how they are computed changes, with the kernels
+ * chosen by crc_kernel() (see crc_kernel.h).
+ *
+ * CRC16() goes on from prev_crc. CRC32() still ignores prev_crc and starts
+ * from 0, as the zlib wrapper it replaces did: crc32_update() chains CRC32.
  */
 
 
-#include "include/crc.h"	// Headers for the CRC functionality
+#include <stddef.h>
+#include <string.h>
+
+#include "include/crc.h"		// Headers for the CRC functionality
+#include "include/crc_kernel.h"	// Headers for the choice of kernel
 
-#include <zlib.h>			// Auxiliary library for CRC32
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>			// PCLMULQDQ and SSSE3 intrinsics
+#define CRC_HAVE_CLMUL
+#elif defined(__aarch64__)
+#include <arm_acle.h>			// CRC32 instructions
+#include <sys/auxv.h>			// Features of the CPU
+#include <asm/hwcap.h>
+#define CRC_HAVE_ARMV8
+#endif
+
+#define CRC32_POLY 0x04C11DB7U				// CRC32 of zlib, reflected, pre and post inverted
+#define CRC64_POLY 0x42F0E1EBA9EA3693ULL	// CRC-64/XZ (ECMA-182), reflected, pre and post inverted
+#define CRC_FOLD_MIN 128					// Shorter buffers are not worth folding
 
 // Look-up table for CRC16
 static const uint16_t crc16tab[256]= {
@@ -49,6 +71,354 @@ static const uint16_t crc16tab[256]= {
 	0x6e17,0x7e36,0x4e55,0x5e74,0x2e93,0x3eb2,0x0ed1,0x1ef0
 };
 
+// Slicing tables: tab[k][i] is the CRC of the byte i followed by k zero bytes
+static uint16_t crc16_slice[8][256];
+static uint32_t crc32_slice[8][256];
+static uint64_t crc64_slice[8][256];
+
+// Folding constants, x^n mod P in the bit order of each CRC, for 512, 384, 256 and 128 bits
+static uint64_t crc16_fold[4][2], crc32_fold[4][2], crc64_fold[4][2];
+
+// Kernel in use
+static int crc_current = -1;
+static uint16_t (*crc16_fn)(uint16_t crc, const unsigned char *buffer, size_t length);
+static uint32_t (*crc32_fn)(uint32_t crc, const unsigned char *buffer, size_t length);
+static uint64_t (*crc64_fn)(uint64_t crc, const unsigned char *buffer, size_t length);
+
+
+/* 8 bytes of the buffer as a little endian number */
+static inline uint64_t load64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+/* The width bits of v in the opposite order */
+static uint64_t reflect(uint64_t v, int width)
+{
+	uint64_t r = 0;
+	int i;
+
+	for(i = 0; i < width; i++, v >>= 1){
+		r = (r << 1) | (v & 1);
+	}
+	return r;
+}
+
+/* x^n mod P, for the polynomial P of degree width without its top bit, with x^0 in bit 0 */
+static uint64_t xpow_mod(int n, uint64_t poly, int width)
+{
+	uint64_t top = 1ULL << (width - 1), r = 1;
+
+	while(n-- > 0){
+		r = (r & top) ? (r << 1) ^ poly : r << 1;
+	}
+	return width == 64 ? r : r & ((top << 1) - 1);
+}
+
+/*
+ * Constants to fold a 128-bit register over 512, 384, 256 and 128 bits. In
+ * the reflected order the low half holds the highest powers, and the product
+ * of two reflected halves comes out one power short.
+ */
+static void fold_consts(uint64_t k[4][2], uint64_t poly, int width, int reflected)
+{
+	static const int dist[4] = {512, 384, 256, 128};
+	int j;
+
+	for(j = 0; j < 4; j++){
+		if(reflected){
+			k[j][0] = reflect(xpow_mod(dist[j] + 63, poly, width), width) << (64 - width);
+			k[j][1] = reflect(xpow_mod(dist[j] - 1, poly, width), width) << (64 - width);
+		}
+		else{
+			k[j][0] = xpow_mod(dist[j], poly, width);
+			k[j][1] = xpow_mod(dist[j] + 64, poly, width);
+		}
+	}
+}
+
+/* Builds the tables and the folding constants */
+static void crc_tables(void)
+{
+	uint32_t c32, p32 = (uint32_t) reflect(CRC32_POLY, 32);
+	uint64_t c64, p64 = reflect(CRC64_POLY, 64);
+	int i, j, k;
+
+	for(i = 0; i < 256; i++){
+		crc16_slice[0][i] = crc16tab[i];
+		c32 = i;
+		c64 = i;
+		for(j = 0; j < 8; j++){
+			c32 = (c32 & 1) ? (c32 >> 1) ^ p32 : c32 >> 1;
+			c64 = (c64 & 1) ? (c64 >> 1) ^ p64 : c64 >> 1;
+		}
+		crc32_slice[0][i] = c32;
+		crc64_slice[0][i] = c64;
+	}
+	for(k = 1; k < 8; k++){
+		for(i = 0; i < 256; i++){
+			crc16_slice[k][i] = (crc16_slice[k-1][i] << 8) ^ crc16tab[crc16_slice[k-1][i] >> 8];
+			crc32_slice[k][i] = (crc32_slice[k-1][i] >> 8) ^ crc32_slice[0][crc32_slice[k-1][i] & 0xFF];
+			crc64_slice[k][i] = (crc64_slice[k-1][i] >> 8) ^ crc64_slice[0][crc64_slice[k-1][i] & 0xFF];
+		}
+	}
+	fold_consts(crc16_fold, 0x1021, 16, 0);
+	fold_consts(crc32_fold, CRC32_POLY, 32, 1);
+	fold_consts(crc64_fold, CRC64_POLY, 64, 1);
+}
+
+
+/********************************************************/
+/*A TABLE LOOKUP PER BYTE*/
+
+static uint16_t crc16_byte(uint16_t crc, const unsigned char *buffer, size_t length)
+{
+	while(length-- > 0){
+		crc = (crc << 8) ^ crc16tab[(crc >> 8) ^ *buffer++];
+	}
+	return crc;
+}
+
+static uint32_t crc32_byte(uint32_t crc, const unsigned char *buffer, size_t length)
+{
+	while(length-- > 0){
+		crc = (crc >> 8) ^ crc32_slice[0][(crc ^ *buffer++) & 0xFF];
+	}
+	return crc;
+}
+
+static uint64_t crc64_byte(uint64_t crc, const unsigned char *buffer, size_t length)
+{
+	while(length-- > 0){
+		crc = (crc >> 8) ^ crc64_slice[0][(crc ^ *buffer++) & 0xFF];
+	}
+	return crc;
+}
+
+
+/********************************************************/
+/*SLICING-BY-8*/
+
+static uint16_t crc16_slice8(uint16_t crc, const unsigned char *buffer, size_t length)
+{
+	const unsigned char *p = buffer;
+
+	//The CRC goes into the first two bytes, which come out of the highest tables
+	for(; length >= 8; length -= 8, p += 8){
+		crc = crc16_slice[7][p[0] ^ (crc >> 8)] ^ crc16_slice[6][p[1] ^ (crc & 0xFF)] ^
+			crc16_slice[5][p[2]] ^ crc16_slice[4][p[3]] ^ crc16_slice[3][p[4]] ^
+			crc16_slice[2][p[5]] ^ crc16_slice[1][p[6]] ^ crc16_slice[0][p[7]];
+	}
+	return crc16_byte(crc, p, length);
+}
+
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *buffer, size_t length)
+{
+	const unsigned char *p = buffer;
+	uint64_t v;
+
+	for(; length >= 8; length -= 8, p += 8){
+		v = load64(p) ^ crc;
+		crc = crc32_slice[7][v & 0xFF] ^ crc32_slice[6][(v >> 8) & 0xFF] ^
+			crc32_slice[5][(v >> 16) & 0xFF] ^ crc32_slice[4][(v >> 24) & 0xFF] ^
+			crc32_slice[3][(v >> 32) & 0xFF] ^ crc32_slice[2][(v >> 40) & 0xFF] ^
+			crc32_slice[1][(v >> 48) & 0xFF] ^ crc32_slice[0][v >> 56];
+	}
+	return crc32_byte(crc, p, length);
+}
+
+static uint64_t crc64_slice8(uint64_t crc, const unsigned char *buffer, size_t length)
+{
+	const unsigned char *p = buffer;
+	uint64_t v;
+
+	for(; length >= 8; length -= 8, p += 8){
+		v = load64(p) ^ crc;
+		crc = crc64_slice[7][v & 0xFF] ^ crc64_slice[6][(v >> 8) & 0xFF] ^
+			crc64_slice[5][(v >> 16) & 0xFF] ^ crc64_slice[4][(v >> 24) & 0xFF] ^
+			crc64_slice[3][(v >> 32) & 0xFF] ^ crc64_slice[2][(v >> 40) & 0xFF] ^
+			crc64_slice[1][(v >> 48) & 0xFF] ^ crc64_slice[0][v >> 56];
+	}
+	return crc64_byte(crc, p, length);
+}
+
+
+/********************************************************/
+/*CARRY-LESS MULTIPLY*/
+
+#ifdef CRC_HAVE_CLMUL
+/*
+ * Four registers run over the buffer 64 bytes at a time. Each step multiplies
+ * the two halves of a register by x^n mod P for the distance it moves, so the
+ * buffer keeps its remainder mod P while it shrinks. The last 16 bytes that are
+ * left have the same CRC from 0 as the blocks folded into them. With reflected
+ * set, the bits of each byte go from the highest power down, as in CRC32 and
+ * CRC64; otherwise from the lowest, as in CRC16, and the bytes are swapped.
+ */
+__attribute__((target("pclmul,ssse3")))
+static void clmul_fold(const unsigned char *buffer, size_t blocks, __m128i init, uint64_t k[4][2], int reflected, unsigned char *out)
+{
+	const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i x[4], d, kk;
+	size_t b;
+	int j;
+
+	for(j = 0; j < 4; j++){
+		x[j] = _mm_loadu_si128((const __m128i *) (buffer + 16 * j));
+		if(j == 0){
+			x[0] = _mm_xor_si128(x[0], init);
+		}
+		if(!reflected){
+			x[j] = _mm_shuffle_epi8(x[j], swap);
+		}
+	}
+
+	//Low halves times k[..][0], high halves times k[..][1]
+	kk = _mm_set_epi64x(k[0][1], k[0][0]);
+	for(b = 1; b < blocks; b++){
+		for(j = 0; j < 4; j++){
+			d = _mm_loadu_si128((const __m128i *) (buffer + 64 * b + 16 * j));
+			if(!reflected){
+				d = _mm_shuffle_epi8(d, swap);
+			}
+			x[j] = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x[j], kk, 0x00), _mm_clmulepi64_si128(x[j], kk, 0x11)), d);
+		}
+	}
+
+	//The first three registers, 384, 256 and 128 bits away from the last one
+	for(j = 0; j < 3; j++){
+		kk = _mm_set_epi64x(k[j+1][1], k[j+1][0]);
+		x[3] = _mm_xor_si128(x[3], _mm_xor_si128(_mm_clmulepi64_si128(x[j], kk, 0x00), _mm_clmulepi64_si128(x[j], kk, 0x11)));
+	}
+	if(!reflected){
+		x[3] = _mm_shuffle_epi8(x[3], swap);
+	}
+	_mm_storeu_si128((__m128i *) out, x[3]);
+}
+
+static uint16_t crc16_clmul(uint16_t crc, const unsigned char *buffer, size_t length)
+{
+	unsigned char r[16];
+	size_t blocks = length / 64;
+
+	if(length < CRC_FOLD_MIN){
+		return crc16_slice8(crc, buffer, length);
+	}
+	//The CRC goes into the first two bytes, in the order they are read
+	clmul_fold(buffer, blocks, _mm_cvtsi32_si128(__builtin_bswap16(crc)), crc16_fold, 0, r);
+	return crc16_slice8(crc16_slice8(0, r, 16), buffer + 64 * blocks, length - 64 * blocks);
+}
+
+static uint32_t crc32_clmul(uint32_t crc, const unsigned char *buffer, size_t length)
+{
+	unsigned char r[16];
+	size_t blocks = length / 64;
+
+	if(length < CRC_FOLD_MIN){
+		return crc32_slice8(crc, buffer, length);
+	}
+	clmul_fold(buffer, blocks, _mm_cvtsi32_si128(crc), crc32_fold, 1, r);
+	return crc32_slice8(crc32_slice8(0, r, 16), buffer + 64 * blocks, length - 64 * blocks);
+}
+
+static uint64_t crc64_clmul(uint64_t crc, const unsigned char *buffer, size_t length)
+{
+	unsigned char r[16];
+	size_t blocks = length / 64;
+
+	if(length < CRC_FOLD_MIN){
+		return crc64_slice8(crc, buffer, length);
+	}
+	clmul_fold(buffer, blocks, _mm_set_epi64x(0, crc), crc64_fold, 1, r);
+	return crc64_slice8(crc64_slice8(0, r, 16), buffer + 64 * blocks, length - 64 * blocks);
+}
+#endif
+
+#ifdef CRC_HAVE_ARMV8
+/* The CRC32 instructions of ARMv8 use the polynomial of zlib, without the inversions */
+__attribute__((target("+crc")))
+static uint32_t crc32_armv8(uint32_t crc, const unsigned char *buffer, size_t length)
+{
+	for(; length >= 8; length -= 8, buffer += 8){
+		crc = __crc32d(crc, load64(buffer));
+	}
+	while(length-- > 0){
+		crc = __crc32b(crc, *buffer++);
+	}
+	return crc;
+}
+#endif
+
+
+/********************************************************/
+/*CHOICE OF KERNEL*/
+
+/* 1 if the CPU can run the CRC_HW kernel */
+static int crc_hw(void)
+{
+#if defined(CRC_HAVE_CLMUL)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#elif defined(CRC_HAVE_ARMV8)
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * @brief 	Sets the kernel used from now on, CRC_ANY, CRC_BYTE, CRC_SLICE or
+ * 			CRC_HW. It is chosen with CRC_ANY on the first CRC if not set.
+ * @return 	The kernel set, -1 if the CPU cannot run it.
+ */
+int crc_kernel(int kernel)
+{
+	if(kernel < CRC_ANY || kernel > CRC_HW || (kernel == CRC_HW && !crc_hw())){
+		return -1;
+	}
+	if(crc_current == -1){
+		crc_tables();
+	}
+	if(kernel == CRC_ANY){
+		kernel = crc_hw() ? CRC_HW : CRC_SLICE;
+	}
+
+	switch(kernel){
+		case CRC_BYTE:
+			crc16_fn = crc16_byte;
+			crc32_fn = crc32_byte;
+			crc64_fn = crc64_byte;
+		break;
+
+		case CRC_SLICE:
+			crc16_fn = crc16_slice8;
+			crc32_fn = crc32_slice8;
+			crc64_fn = crc64_slice8;
+		break;
+
+		case CRC_HW:
+#if defined(CRC_HAVE_CLMUL)
+			crc16_fn = crc16_clmul;
+			crc32_fn = crc32_clmul;
+			crc64_fn = crc64_clmul;
+#elif defined(CRC_HAVE_ARMV8)
+			crc16_fn = crc16_slice8;
+			crc32_fn = crc32_armv8;
+			crc64_fn = crc64_slice8;
+#endif
+		break;
+	}
+	crc_current = kernel;
+	return kernel;
+}
+
+
 /*
  * @brief	CRC16 implementation based on a CRC16-CCITT implementation variant with init value of 0.
  *
@@ -73,25 +443,57 @@ static const uint16_t crc16tab[256]= {
  */
 uint16_t CRC16(const unsigned char* buffer, unsigned int length, uint16_t prev_crc)
 {
-	register int counter;
-	register uint16_t crc = prev_crc;
-	for( counter = 0; counter < length; counter++)
-		crc = (crc<<8) ^ crc16tab[((crc>>8) ^ *(char *)buffer++)&0x00FF];
-	return crc;
+	if(crc_current == -1){
+		crc_kernel(CRC_ANY);
+	}
+	return crc16_fn(prev_crc, buffer, length);
 }
 
 
 /*
- * @brief	CRC32 wrapper for ZLIB's CRC32 implementation with init value set to 0.
+ * @brief	CRC32 of zlib with init value set to 0.
  *
  * @param	<buffer> to compute the CRC on.
  * @param	<length> of the buffer, in bytes.
- * @param	<prev_crc> CRC of the previous block.
+ * @param	<prev_crc> Ignored, unlike in CRC16(): the zlib wrapper this
+ * 			replaces always started from 0, and so does this one.
  * @return	A 32-bit unsigned integer containing the resulting CRC.
  */
 uint32_t CRC32(const unsigned char* buffer, unsigned int length, uint32_t prev_crc)
 {
-	return (uint32_t) (crc32(crc32(prev_crc, Z_NULL, 0), buffer, length) & 0xFFFFFFFF);
+	if(crc_current == -1){
+		crc_kernel(CRC_ANY);
+	}
+	return ~crc32_fn(0xFFFFFFFFU, buffer, length);
+}
+
+
+/*
+ * @brief 	Goes on with the CRC32 crc of the data before buffer, as crc32() of
+ * 			zlib does: starting from 0, the pieces of a buffer give the same
+ * 			result as CRC32() of the whole buffer, which does not chain.
+ * @return 	The CRC32 of the data before buffer followed by buffer.
+ */
+uint32_t crc32_update(uint32_t crc, const unsigned char *buffer, unsigned int length)
+{
+	if(crc_current == -1){
+		crc_kernel(CRC_ANY);
+	}
+	return ~crc32_fn(~crc, buffer, length);
 }
 
 
+/*
+ * @brief	CRC-64/XZ (ECMA-182 polynomial, reflected, init and final xor of all ones).
+ *
+ * @param	<buffer> to compute the CRC on.
+ * @param	<length> of the buffer, in bytes.
+ * @return	A 64-bit unsigned integer containing the resulting CRC.
+ */
+uint64_t CRC64(const unsigned char * buffer, unsigned int length)
+{
+	if(crc_current == -1){
+		crc_kernel(CRC_ANY);
+	}
+	return ~crc64_fn(~0ULL, buffer, length);
+}
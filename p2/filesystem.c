@@ -11,24 +11,64 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "include/filesystem.h"		// Headers for the core functionality
 #include "include/auxiliary.h"		// Headers for auxiliary functions
 #include "include/metadata.h"		// Type and structure declaration of the file system
 #include "include/crc.h"			// Headers for the CRC functionality
+#include "include/crc_kernel.h"		// Headers for the CRC32 in pieces
+#include "include/device.h"			// Headers for the device handle
+#include "include/cache.h"			// Headers for the block cache
+#include "include/layout.h"			// Headers for the layout of the files
+#include "include/directory.h"		// Headers for the directories
 
+#define FILE_VEC 64		// Whole blocks of a file moved per breadv()/bwritev()
 
 struct superblock *sblocks;
 struct fs_bitmap *bitmaps;
 struct inode *inodes;
 
+/* Extents of each file in memory, loaded from the inode and its extent blocks when first used */
+struct extent_map{
+	int loaded;
+	int count;					// Number of extents
+	int max;					// Room in ext and first
+	struct extent *ext;			// Extents, in file order
+	unsigned int *first;		// Block of the file where each extent starts
+	int nchain;					// Number of extent blocks
+	unsigned int *chain;		// Extent blocks, in order
+} maps[NUM_INODES];
+
+/* Last block of pointers used at each depth, so that reading a file in order does not read them again */
+struct ptr_cache{
+	unsigned int block;				// Device block, 0 if none
+	unsigned int ptr[BLOCK_PTRS];
+} ptrs[3];
+/* Free data blocks of each group of the bitmap, so that full groups are skipped */
+unsigned short group_free[(MAX_BLOCKS + GROUP_BLOCKS - 1) / GROUP_BLOCKS];
+unsigned int alloc_hint;			// Where balloc() looks for the next block
+
+/* Names found in the directories, by directory and name, with a chain of inodes in each bucket */
+struct name_index{
+	unsigned int mask;			// Number of buckets - 1
+	int *buckets;				// First inode of each bucket, -1 if none
+	int *next;					// Next inode in the same bucket
+	unsigned int *hash;			// Hash of the name of each inode
+	int *parent;				// Directory of each inode, -1 if it is not in the index
+} names;
+
+int new_layout = LAYOUT_EXTENTS;	// Layout of the files of the next mkFS()
+char written[NUM_INODES];			// Files written since they were opened, whose crc is out of date
+
 /*
  * @brief 	Generates the proper file system structure in a storage device, as designed by the student.
  * @return 	0 if success, -1 otherwise.
  */
 int mkFS(long deviceSize)
 {
-	int i;
+	int i, n = deviceSize/BLOCK_SIZE;
+	struct bvec *vec;
 
 	//Check device size
 	if(deviceSize < MIN_DISK_SIZE || deviceSize > MAX_DISK_SIZE){
@@ -36,26 +76,69 @@ int mkFS(long deviceSize)
 		return -1;
 	}
 
+	//Keep the device open while it is formatted, unmountFS() closes it
+	if(dev_open(DEVICE_IMAGE) == -1){
+		printf("[ERROR] Cannot open the device\n");
+		return -1;
+	}
+	if(deviceSize > dev_size()){
+		printf("[ERROR] The device is smaller than %ld bytes\n", deviceSize);
+		dev_close();
+		return -1;
+	}
+
+	//Every block is written from the same zeroed buffer, in as few calls as possible
 	char reset[BLOCK_SIZE];
 	bzero(reset, BLOCK_SIZE);
-	for (i = 0; i < (deviceSize/BLOCK_SIZE); i++){
-		if (bwrite(DEVICE_IMAGE, i, reset) == -1){
-			printf("[ERROR] Error reseting device: %d\n", i);
-			return -1;
-		}
+	if((vec = malloc(sizeof(struct bvec) * n)) == NULL){
+		printf("[ERROR] Error reseting device\n");
+		dev_close();
+		return -1;
+	}
+	for (i = 0; i < n; i++){
+		vec[i].block = i;
+		vec[i].buffer = reset;
+	}
+	if (bwritev(DEVICE_IMAGE, vec, n) == -1){
+		for (i = 0; vec[i].status == 0; i++);
+		printf("[ERROR] Error reseting device: %d\n", i);
+		free(vec);
+		dev_close();
+		return -1;
 	}
+	free(vec);
 
 	//Reset superblocks, maps and inodes
 	sblocks = malloc(sizeof(struct superblock));
+	bitmaps = calloc(1, sizeof(struct fs_bitmap));
+	inodes = calloc(NUM_INODES, sizeof(struct inode));
 	sblocks[0].magicNum = 0x29A;
-	sblocks[0].mapNumBlocks = 3;
+	sblocks[0].mapNumBlocks = BITMAP_BLOCKS;
 	sblocks[0].numinodes = NUM_INODES; //TODO: Check if MAX_FILES or NUM_INODES
-	sblocks[0].firstinode = 5;
-	sblocks[0].dataNumBlock = (unsigned int) ((deviceSize-7*BLOCK_SIZE)/BLOCK_SIZE);
-	sblocks[0].firstDataBlock = 7;
+	sblocks[0].firstinode = 2 + BITMAP_BLOCKS;
+	sblocks[0].dataNumBlock = (unsigned int) ((deviceSize-(2+BITMAP_BLOCKS+INODE_BLOCKS)*BLOCK_SIZE)/BLOCK_SIZE);
+	sblocks[0].firstDataBlock = 2 + BITMAP_BLOCKS + INODE_BLOCKS;
 	sblocks[0].deviceSize = deviceSize;
+	sblocks[0].fileLayout = new_layout;
 	sblocks[0].crc = 0;
 
+	//The bits past the last data block are never free
+	for(i = sblocks[0].dataNumBlock; i < MAX_BLOCKS; i++){
+		bitmap_setbit((char *) bitmaps->dataBlocks_map, i, 1);
+	}
+	bitmap_count();
+
+	//The root directory, which takes the first inode
+	i = ialloc();
+	inodes[i].type = T_DIR;
+	if(dir_create(i) == -1){
+		printf("[ERROR] Cannot make the root directory\n");
+		free(inodes);
+		free(bitmaps);
+		free(sblocks);
+		dev_close();
+		return -1;
+	}
 
 	//Unmount the file system from the device to write the default file system into disk
 	if(unmountFS() == -1){
@@ -72,46 +155,56 @@ int mkFS(long deviceSize)
  */
 int mountFS(void)
 {
-	int i,j;
-	char buf[BLOCK_SIZE], bm_buf[3*BLOCK_SIZE];
+	int i;
+	char buf[BLOCK_SIZE];
+	struct bvec vec[1 + BITMAP_BLOCKS + INODE_BLOCKS];
+
+	if(dev_open(DEVICE_IMAGE) == -1){
+		printf("[ERROR] Cannot mount the fs. Error opening the device\n");
+		return -1;
+	}
 
 	//Allocate memory
 	sblocks = malloc(sizeof(struct superblock));
 	bitmaps = malloc(sizeof(struct fs_bitmap));
 	inodes = malloc (sizeof(struct inode) * NUM_INODES);
 
-	//Read superblock
-	if(bread(DEVICE_IMAGE, 1, buf) == -1){
-		printf("[ERROR] Cannot mount the fs. Error reading superblock\n");
+	//Read superblock and bitmaps, which are consecutive
+	vec[0].block = 1;
+	vec[0].buffer = buf;
+	for(i = 0; i < BITMAP_BLOCKS ; i++){
+		vec[i+1].block = i+2;
+		vec[i+1].buffer = (char *) bitmaps + (i*BLOCK_SIZE);
+	}
+	if(breadv(DEVICE_IMAGE, vec, 1 + BITMAP_BLOCKS) == -1){
+		if(vec[0].status == -1){
+			printf("[ERROR] Cannot mount the fs. Error reading superblock\n");
+		}
+		else{
+			printf("[ERROR] Cannot mount the fs. Error reading bitmaps\n");
+		}
+		dev_close();
 		return -1;
 	}
 	struct superblock *temp_sb = (struct superblock *) buf;
 	sblocks[0] = *temp_sb;
+	bitmap_count();
+	bzero(written, sizeof(written));
 
-	//Read bitmaps
-	for(i = 0; i < 3 ; i++){	//bitmaps fill 3 blocks in memory
-		if(bread(DEVICE_IMAGE, i+2, bm_buf + (i*BLOCK_SIZE)) == -1){
-			printf("[ERROR] Cannot mount the fs. Error reading bitmaps\n");
-			return -1;
-		}
+	//Read inodes, once the superblock says where they are
+	for(i = 0; i < INODE_BLOCKS ; i++){
+		vec[i].block = i + sblocks[0].firstinode;
+		vec[i].buffer = (char *) inodes + (i*BLOCK_SIZE);
 	}
-	struct fs_bitmap *temp_bm = (struct fs_bitmap *) bm_buf;
-	bitmaps[0] = *temp_bm;
-
-	//Read inodes
-	for(i = 0; i < 2 ; i++){	//inodes fill 2 blocks in memory
-		if(bread(DEVICE_IMAGE, (i + sblocks[0].firstinode), buf) == -1 ){
-			printf("[ERROR] Cannot mount the fs. Error reading inodes\n");
-			return -1;
-		}
-		else{
-			for(j = 0; j < 32; j++){
-				char inode_buf[sizeof(struct inode)];
-				memcpy(inode_buf, buf + (sizeof(struct inode) * j), sizeof(struct inode)); //Copy single inodes
-				struct inode *temp_in = (struct inode *) inode_buf;
-				inodes[j] = *temp_in;
-			}
-		}
+	if(breadv(DEVICE_IMAGE, vec, INODE_BLOCKS) == -1){
+		printf("[ERROR] Cannot mount the fs. Error reading inodes\n");
+		dev_close();
+		return -1;
+	}
+	if(name_open() == -1){
+		printf("[ERROR] Cannot mount the fs. Error indexing file names\n");
+		dev_close();
+		return -1;
 	}
 
 	//TODO: Check integrity
@@ -130,100 +223,197 @@ int mountFS(void)
 int unmountFS(void)
 {
 	int i;
+	char buf[BLOCK_SIZE];
+	struct bvec vec[1 + BITMAP_BLOCKS + INODE_BLOCKS];
 
-	//Write inodes
-	for(i = 0; i < 2 ; i++){	//inodes fill 2 blocks in memory
-		if(bwrite(DEVICE_IMAGE, (i + sblocks[0].firstinode), ((char *) inodes + (i*BLOCK_SIZE))) == -1 ){
-			printf("[ERROR] Cannot unmount the fs. Error writing inodes\n");
-			return -1;
+	//TODO: CALCULATE NEW CRC
+
+	//Files still open keep their data, so their crc has to match it
+	for(i = 0; i < NUM_INODES; i++){
+		if(written[i]){
+			inodes[i].crc = CRCheck(F_ID, i);
+			written[i] = 0;
 		}
 	}
 
-	//Write bitmaps
-	for(i = 0; i < 3 ; i++){	//bitmaps fill 3 blocks in memory
-		if(bwrite(DEVICE_IMAGE, i+2, ((char *) bitmaps + (i*BLOCK_SIZE))) == -1){
-			printf("[ERROR] Cannot unmount the fs. Error writing bitmaps\n");
-			return -1;
-		}
+	//Superblock, which is a bit smaller than a block
+	bzero(buf, BLOCK_SIZE);
+	memcpy(buf, sblocks, sizeof(struct superblock));
+	vec[0].block = 1;
+	vec[0].buffer = buf;
+
+	//Bitmaps
+	for(i = 0; i < BITMAP_BLOCKS ; i++){
+		vec[i+1].block = i+2;
+		vec[i+1].buffer = (char *) bitmaps + (i*BLOCK_SIZE);
 	}
 
-	//TODO: CALCULATE NEW CRC
+	//Inodes
+	for(i = 0; i < INODE_BLOCKS ; i++){
+		vec[i+1+BITMAP_BLOCKS].block = i + sblocks[0].firstinode;
+		vec[i+1+BITMAP_BLOCKS].buffer = (char *) inodes + (i*BLOCK_SIZE);
+	}
 
-	//Write superblock
-	if(bwrite(DEVICE_IMAGE, 1, (char *) sblocks) == -1){
-		printf("[ERROR] Cannot unmount the fs. Error writing superblock\n");
+	//All the metadata in a single call
+	if(bwritev(DEVICE_IMAGE, vec, 1 + BITMAP_BLOCKS + INODE_BLOCKS) == -1){
+		if(vec[0].status == -1){
+			printf("[ERROR] Cannot unmount the fs. Error writing superblock\n");
+		}
+		else if(vec[1].status == -1){
+			printf("[ERROR] Cannot unmount the fs. Error writing bitmaps\n");
+		}
+		else{
+			printf("[ERROR] Cannot unmount the fs. Error writing inodes\n");
+		}
 		return -1;
 	}
 
 	//Free resources
+	for(i = 0; i < NUM_INODES; i++){
+		extent_unload(i);
+	}
+	bzero(ptrs, sizeof(ptrs));
+	name_close();
 	free(inodes);
 	free(bitmaps);
 	free(sblocks);
 
+	if(cache_flush() == -1){
+		printf("[ERROR] Cannot unmount the fs. Error writing the cache\n");
+		dev_close();
+		return -1;
+	}
+	if(dev_close() == -1){
+		printf("[ERROR] Cannot unmount the fs. Error closing the device\n");
+		return -1;
+	}
+
 	return 0;
 }
 
-/*
- * @brief	Creates a new file, provided it it doesn't exist in the file system.
- * @return	0 if success, -1 if the file already exists, -2 in case of error.
- */
-int createFile(char *fileName)
+/* Creates the file or directory of the path, of the given type */
+static int path_create(char *path, int type)
 {
-	int i, b;
-	if(namei(fileName) != -1){
-		printf("[ERROR] Error creating file. The file already exists\n");
+	char name[MAX_FILE_NAME+1];
+	int d, i;
+
+	if((d = path_walk(path, name)) < 0){
+		printf("[ERROR] Cannot create %s. %s\n", path, d == -1 ? "A directory of the path doesn't exist" : "No valid path");
+		return -2;
+	}
+	if(name_lookup(d, name) != -1){
+		printf("[ERROR] Cannot create %s. It already exists\n", path);
 		return -1;
 	}
 
 	if((i = ialloc())==-1){
-		printf("[ERROR] Error creating file. Cannot allocate inode\n");
+		printf("[ERROR] Cannot create %s. Cannot allocate inode\n", path);
 		return -2;
 	}
-	if((b = balloc())==-1){
-		printf("[ERROR] Error creating file. Cannot allocate data block\n");
+	//Set inode data, without blocks until the file is written
+	bzero(&inodes[i], sizeof(struct inode));
+	written[i] = 0;
+	strcpy(inodes[i].name, name);
+	inodes[i].type = type;
+	inodes[i].status = CLOSE;
+	if(type == T_DIR && dir_create(i) == -1){
+		printf("[ERROR] Cannot create %s. Cannot allocate the directory\n", path);
+		ifree(i);
 		return -2;
 	}
-
-	//Set inode data
-	strcpy(inodes[i].name, fileName);
-	inodes[i].size = 1;
-	inodes[i].status = CLOSE;
-	inodes[i].position = 0;
-	inodes[i].directBlock = b;
-	inodes[i].crc = 0;
+	if(dir_add(d, i) == -1){
+		printf("[ERROR] Cannot create %s. Error adding it to its directory\n", path);
+		if(type == T_DIR){
+			dir_free(inodes[i].dirRoot);
+		}
+		ifree(i);
+		return -2;
+	}
+	name_add(i, d);
 
 	return 0;
 }
 
-/*
- * @brief	Deletes a file, provided it exists in the file system.
- * @return	0 if success, -1 if the file does not exist, -2 in case of error..
- */
-int removeFile(char *fileName)
+/* Deletes the file or directory of the path, if it has the given type */
+static int path_remove(char *path, int type)
 {
-	int i, j;
+	char name[MAX_FILE_NAME+1];
+	int d, i;
 
-	//Check if file exists
-	if((i = namei(fileName)) == -1){
-		printf("[ERROR] Cannot remove file %s. The file doesn't exist\n", fileName);
+	//Check if it exists
+	if((d = path_walk(path, name)) == -2){
+		printf("[ERROR] Cannot remove %s. No valid path\n", path);
+		return -2;
+	}
+	if(d == -1 || (i = name_lookup(d, name)) == -1){
+		printf("[ERROR] Cannot remove %s. It doesn't exist\n", path);
 		return -1;
 	}
+	if(inodes[i].type != type){
+		printf("[ERROR] Cannot remove %s. It is %s directory\n", path, type == T_DIR ? "not a" : "a");
+		return -2;
+	}
+	if(type == T_DIR && inodes[i].numEntries != 0){
+		printf("[ERROR] Cannot remove %s. The directory is not empty\n", path);
+		return -2;
+	}
 
+	if(dir_del(d, i) == -1){
+		printf("[ERROR] Cannot remove %s. Error removing it from its directory\n", path);
+		return -2;
+	}
+	name_del(i);
 	if(ifree(i) == -1){
-		printf("[ERROR] Cannot remove file %s. Error freeing bitmap position\n", fileName);
+		printf("[ERROR] Cannot remove %s. Error freeing bitmap position\n", path);
 		return -2;
 	}
 
-	for(j = inodes[i].directBlock; j<inodes[i].size;i++){
-		if(bfree(j) == -1){
-			printf("[ERROR] Cannot remove file %s. Error freeing datablock\n", fileName);
-			return -2;
-		}
+	if((type == T_DIR ? dir_free(inodes[i].dirRoot) : file_free(i)) == -1){
+		printf("[ERROR] Cannot remove %s. Error freeing datablock\n", path);
+		return -2;
 	}
+	inodes[i].size = 0;
+	written[i] = 0;
 
 	return 0;
 }
 
+/*
+ * @brief	Creates a new file, provided it it doesn't exist in the file system.
+ * @return	0 if success, -1 if the file already exists, -2 in case of error.
+ */
+int createFile(char *fileName)
+{
+	return path_create(fileName, T_FILE);
+}
+
+/*
+ * @brief	Deletes a file, provided it exists in the file system.
+ * @return	0 if success, -1 if the file does not exist, -2 in case of error..
+ */
+int removeFile(char *fileName)
+{
+	return path_remove(fileName, T_FILE);
+}
+
+/*
+ * @brief 	Creates a new directory, provided it doesn't exist in the file system.
+ * @return 	0 if success, -1 if it already exists, -2 in case of error.
+ */
+int mkDir(char *path)
+{
+	return path_create(path, T_DIR);
+}
+
+/*
+ * @brief 	Deletes a directory, provided it exists and is empty.
+ * @return 	0 if success, -1 if it does not exist, -2 in case of error.
+ */
+int rmDir(char *path)
+{
+	return path_remove(path, T_DIR);
+}
+
 /*
  * @brief	Opens an existing file.
  * @return	The file descriptor if possible, -1 if file does not exist, -2 in case of error..
@@ -237,6 +427,10 @@ int openFile(char *fileName)
 		printf("[ERROR] Cannot open file %s. The file doesn't exist\n", fileName);
 		return -1;
 	}
+	if(inodes[i].type == T_DIR){
+		printf("[ERROR] Cannot open file %s. It is a directory\n", fileName);
+		return -2;
+	}
 
 	//Check file integrity
 	if (checkFile(fileName) == -1){
@@ -261,7 +455,7 @@ int openFile(char *fileName)
  */
 int closeFile(int fileDescriptor)
 {
-	if (fileDescriptor < 0 || fileDescriptor >= MAX_FILES){
+	if (fileDescriptor < 0 || fileDescriptor >= MAX_INODES){
 		printf("[ERROR] Cannot close file %d. Invalid file descriptor\n", fileDescriptor);
 		return -1;
 	}
@@ -273,6 +467,12 @@ int closeFile(int fileDescriptor)
 
 	inodes[fileDescriptor].status = CLOSE;
 
+	//The file is checked against this crc when it is opened again
+	if(written[fileDescriptor]){
+		inodes[fileDescriptor].crc = CRCheck(F_ID, fileDescriptor);
+		written[fileDescriptor] = 0;
+	}
+
 	return 0;
 }
 
@@ -282,7 +482,36 @@ int closeFile(int fileDescriptor)
  */
 int readFile(int fileDescriptor, void *buffer, int numBytes)
 {
-	return -1;
+	int n;
+
+	if (fileDescriptor < 0 || fileDescriptor >= MAX_INODES){
+		printf("[ERROR] Cannot read file %d. Invalid file descriptor\n", fileDescriptor);
+		return -1;
+	}
+	if(inodes[fileDescriptor].status == CLOSE){
+		printf("[ERROR] Cannot read file %d. The file is closed\n", fileDescriptor);
+		return -1;
+	}
+	if(buffer == NULL || numBytes < 0){
+		printf("[ERROR] Cannot read file %d. Invalid buffer\n", fileDescriptor);
+		return -1;
+	}
+
+	//Nothing is read past the end of the file
+	n = numBytes;
+	if(inodes[fileDescriptor].position >= inodes[fileDescriptor].size){
+		n = 0;
+	}
+	else if(inodes[fileDescriptor].size - inodes[fileDescriptor].position < n){
+		n = inodes[fileDescriptor].size - inodes[fileDescriptor].position;
+	}
+	if(n > 0 && file_io(fileDescriptor, buffer, n, 0) == -1){
+		printf("[ERROR] Cannot read file %d. Error reading data blocks\n", fileDescriptor);
+		return -1;
+	}
+
+	inodes[fileDescriptor].position += n;
+	return n;
 }
 
 /*
@@ -291,7 +520,48 @@ int readFile(int fileDescriptor, void *buffer, int numBytes)
  */
 int writeFile(int fileDescriptor, void *buffer, int numBytes)
 {
-	return -1;
+	int n;
+	unsigned int position, end;
+
+	if (fileDescriptor < 0 || fileDescriptor >= MAX_INODES){
+		printf("[ERROR] Cannot write file %d. Invalid file descriptor\n", fileDescriptor);
+		return -1;
+	}
+	if(inodes[fileDescriptor].status == CLOSE){
+		printf("[ERROR] Cannot write file %d. The file is closed\n", fileDescriptor);
+		return -1;
+	}
+	if(buffer == NULL || numBytes < 0){
+		printf("[ERROR] Cannot write file %d. Invalid buffer\n", fileDescriptor);
+		return -1;
+	}
+
+	//Blocks are allocated for the whole request, as long as there is room
+	position = inodes[fileDescriptor].position;
+	if((unsigned int) numBytes > MAX_FILE_SIZE - position){
+		numBytes = MAX_FILE_SIZE - position;
+	}
+	if((end = file_grow(fileDescriptor, position / BLOCK_SIZE, (position + numBytes + BLOCK_SIZE - 1) / BLOCK_SIZE)) == -1){
+		printf("[ERROR] Cannot write file %d. Error allocating data blocks\n", fileDescriptor);
+		return -1;
+	}
+	n = numBytes;
+	if((long) end * BLOCK_SIZE < (long) position + n){
+		n = (long) end * BLOCK_SIZE > position ? (long) end * BLOCK_SIZE - position : 0;
+	}
+	if(n > 0 && file_io(fileDescriptor, buffer, n, 1) == -1){
+		printf("[ERROR] Cannot write file %d. Error writing data blocks\n", fileDescriptor);
+		return -1;
+	}
+
+	inodes[fileDescriptor].position += n;
+	if(n > 0 && inodes[fileDescriptor].position > inodes[fileDescriptor].size){
+		inodes[fileDescriptor].size = inodes[fileDescriptor].position;
+	}
+	if(n > 0){
+		written[fileDescriptor] = 1;
+	}
+	return n;
 }
 
 
@@ -302,7 +572,7 @@ int writeFile(int fileDescriptor, void *buffer, int numBytes)
 int lseekFile(int fileDescriptor, long offset, int whence)
 {
 
-	if (fileDescriptor >= MAX_FILES || fileDescriptor < 0){
+	if (fileDescriptor >= MAX_INODES || fileDescriptor < 0){
 		printf("[ERROR] Cannot modify the position of the seek pointer. Invalid file descriptor\n");
 		return -1;
 	}
@@ -311,11 +581,12 @@ int lseekFile(int fileDescriptor, long offset, int whence)
 		return -1;
 	}
 
-	int new_position = inodes[fileDescriptor].position + offset;
+	long new_position = (long) inodes[fileDescriptor].position + offset;
 	switch (whence) {
 
+		//Past the end of the file is allowed, writing there leaves a hole behind
 		case FS_SEEK_CUR:
-			if (new_position < 0 || new_position > inodes[fileDescriptor].size)
+			if (new_position < 0 || new_position > MAX_FILE_SIZE)
 				return -1;
 			else inodes[fileDescriptor].position = new_position;
 		break;
@@ -334,6 +605,21 @@ int lseekFile(int fileDescriptor, long offset, int whence)
 	return 0;
 }
 
+/*
+ * @brief 	Sets the layout of the files, LAYOUT_EXTENTS or LAYOUT_INDIRECT. It
+ * 			takes effect on the next mkFS().
+ * @return 	0 if success, -1 otherwise.
+ */
+int fs_layout(int l)
+{
+	if(l != LAYOUT_EXTENTS && l != LAYOUT_INDIRECT){
+		printf("[ERROR] No valid file layout\n");
+		return -1;
+	}
+	new_layout = l;
+	return 0;
+}
+
 /*
  * @brief 	Verifies the integrity of the file system metadata.
  * @return 	0 if the file system is correct, -1 if the file system is corrupted, -2 in case of error.
@@ -372,10 +658,18 @@ int checkFile(char *fileName)
 
 int ialloc()
 {
-	int i;
-	for(i = 0; i < sblocks[0].numinodes; i++){
-		if(bitmaps->inodes_map[i] == 0){	//Free inodes
-			bitmaps->inodes_map[i] = 1;
+	uint64_t w;
+	int k, i;
+
+	//The first zero bit of each word of the map, among the first MAX_INODES
+	for(k = 0; k * 64 < MAX_INODES; k++){
+		w = ~bitmaps->inodes_map[k];
+		if(MAX_INODES - k * 64 < 64){
+			w &= (1ULL << (MAX_INODES - k * 64)) - 1;
+		}
+		if(w != 0){
+			i = k * 64 + __builtin_ctzll(w);
+			bitmap_setbit((char *) bitmaps->inodes_map, i, 1);
 			return i;
 		}
 	}
@@ -392,28 +686,124 @@ int ifree(int i)
 	}
 
 	bzero(inodes[i].name, MAX_FILE_NAME);
-	bitmaps->inodes_map[i] = 0;
+	bitmap_setbit((char *) bitmaps->inodes_map, i, 0);
 
 	return 0;
 }
 
-int balloc()
+/* Counts the free data blocks of each group, from the bitmap */
+void bitmap_count(void)
 {
-	int i;
-	for(i = 0; i < sblocks[0].dataNumBlock; i++){
-		if(bitmaps->dataBlocks_map[i] == 0){
-			bitmaps->dataBlocks_map[i] = 1;
-			return i;
+	int k;
+
+	bzero(group_free, sizeof(group_free));
+	for(k = 0; k < MAX_BLOCKS / 64; k++){
+		group_free[k * 64 / GROUP_BLOCKS] += 64 - __builtin_popcountll(bitmaps->dataBlocks_map[k]);
+	}
+	alloc_hint = 0;
+}
+
+/* Marks count data blocks from b, all in the same word of the bitmap, as used or free */
+static void bitmap_mark(int b, int count, int used)
+{
+	uint64_t mask = (count == 64 ? ~0ULL : (1ULL << count) - 1) << (b % 64);
+
+	if(used){
+		bitmaps->dataBlocks_map[b / 64] |= mask;
+		group_free[b / GROUP_BLOCKS] -= count;
+	}
+	else{
+		bitmaps->dataBlocks_map[b / 64] &= ~mask;
+		group_free[b / GROUP_BLOCKS] += count;
+	}
+}
+
+/* First free data block from lo to hi, a word at a time, skipping the groups without free blocks */
+static int bitmap_find(int lo, int hi)
+{
+	uint64_t w;
+	int b;
+
+	while(lo < hi){
+		if(group_free[lo / GROUP_BLOCKS] == 0){
+			lo = (lo / GROUP_BLOCKS + 1) * GROUP_BLOCKS;
+			continue;
 		}
+		w = ~bitmaps->dataBlocks_map[lo / 64] & (~0ULL << (lo % 64));
+		if(w != 0){
+			b = lo / 64 * 64 + __builtin_ctzll(w);
+			return b < hi ? b : -1;
+		}
+		lo = (lo / 64 + 1) * 64;
 	}
 	return -1;
 }
 
+int balloc()
+{
+	int got;
+
+	return balloc_run(alloc_hint, 1, &got);
+}
+
+/*
+ * Allocates up to want consecutive data blocks, from the first free block at or
+ * after hint, or else before it. In got it returns how many. The next balloc()
+ * starts after them.
+ * @return The first block, -1 if the device is full.
+ */
+int balloc_run(int hint, int want, int *got)
+{
+	int b, n = sblocks[0].dataNumBlock, s, r;
+	uint64_t w;
+
+	if(hint < 0 || hint >= n){
+		hint = 0;
+	}
+	if((b = bitmap_find(hint, n)) == -1 && (b = bitmap_find(0, hint)) == -1){
+		return -1;
+	}
+
+	//The run goes on up to the next used block, a word at a time
+	for(*got = 0; *got < want && b + *got < n; *got += r){
+		s = (b + *got) % 64;
+		w = bitmaps->dataBlocks_map[(b + *got) / 64] >> s;
+		r = w != 0 ? __builtin_ctzll(w) : 64 - s;
+		if(r > want - *got){
+			r = want - *got;
+		}
+		if(r > n - (b + *got)){
+			r = n - (b + *got);
+		}
+		if(r == 0){
+			break;
+		}
+		bitmap_mark(b + *got, r, 1);
+		if(s + r < 64 && *got + r < want){
+			*got += r;
+			break;
+		}
+	}
+	alloc_hint = b + *got;
+	return b;
+}
+
+/* Frees count data blocks from b, without clearing them */
+void bfree_run(int b, int count)
+{
+	int r;
+
+	for(; count > 0; b += r, count -= r){
+		r = 64 - b % 64 < count ? 64 - b % 64 : count;
+		bitmap_mark(b, r, 0);
+	}
+}
+
 int bfree(int i)
 {
 	char buf[BLOCK_SIZE];
 
-	if(i > sblocks[0].dataNumBlock || i < 0){
+	if(i >= sblocks[0].dataNumBlock || i < 0){
 		printf("[ERROR] Cannot free data block. No valid data block id\n");
 		return -1;
 	}
@@ -423,108 +813,1007 @@ int bfree(int i)
 		printf("[ERROR] Cannot free data block. Error removing block data\n");
 		return -1;
 	}
-	bitmaps->dataBlocks_map[i] = 0;
+	bfree_run(i, 1);
 	return 0;
 }
 
-int namei(char *name)
+/* FNV-1a hash of a file name */
+static unsigned int name_hash(char *name)
 {
-	int i, result=-1;
-	for (i = 0; i < sblocks[0].numinodes; i++){
-		if(!strcmp(inodes[i].name, name)){
-			result = i;
-		}
-		else{
-			result = -1;
-		}
+	unsigned int h = 2166136261u;
+
+	for(; *name != '\0'; name++){
+		h = (h ^ (unsigned char) *name) * 16777619u;
 	}
-	return result;
+	return h;
 }
 
-int bmap(int i, int offset)
+/* Bucket of the name with hash h in the directory d */
+static unsigned int name_bucket(unsigned int h, int d)
 {
-	if(i>sblocks[0].numinodes || i<0 || offset < 0){
-		printf("[ERROR] Cannot locate data block. No valid data block id\n");
-		return -1;
-	}
+	return (h ^ (unsigned int) d * 2654435761u) & names.mask;
+}
 
-	//Return inode block
-	if(offset < BLOCK_SIZE){
-		return inodes[i].directBlock;
-	}
+/* Adds the name of the inode i, in the directory d, to the index */
+void name_add(int i, int d)
+{
+	unsigned int h = name_hash(inodes[i].name);
 
-	return -1;
+	names.hash[i] = h;
+	names.parent[i] = d;
+	names.next[i] = names.buckets[name_bucket(h, d)];
+	names.buckets[name_bucket(h, d)] = i;
 }
 
-int myceil(double x){
-	int y = (int) x, result;
-	if((x - y) > 0){
-		result = y+1;
+/* Removes the name of the inode i from the index, if it is there */
+void name_del(int i)
+{
+	int *p;
+
+	if(names.parent[i] == -1){
+		return;
 	}
-	else{
-		result = y;
+	for(p = &names.buckets[name_bucket(names.hash[i], names.parent[i])]; *p != -1; p = &names.next[*p]){
+		if(*p == i){
+			*p = names.next[i];
+			break;
+		}
 	}
-
-	return result;
+	names.parent[i] = -1;
 }
 
-
-uint32_t CRCheck(int type, int i)
+/* Makes the index empty, with a bucket per inode or more. Names are added as they are found */
+int name_open(void)
 {
-	uint32_t result = -1;
-	char buf[BLOCK_SIZE], *temp_buf;
-	int j;
+	unsigned int n = sblocks[0].numinodes, buckets = 1;
 
-	switch(type) {
-		case SB_ID: //Superblock: get metadata (inodes + bitmaps)
-			temp_buf = malloc(5*BLOCK_SIZE); //3 blocks bitmaps + 2 blocks inodes
+	while(buckets < n){
+		buckets *= 2;
+	}
+	names.mask = buckets - 1;
+	names.buckets = malloc(sizeof(int) * buckets);
+	names.next = malloc(sizeof(int) * n);
+	names.hash = malloc(sizeof(unsigned int) * n);
+	names.parent = malloc(sizeof(int) * n);
+	if(names.buckets == NULL || names.next == NULL || names.hash == NULL || names.parent == NULL){
+		name_close();
+		return -1;
+	}
+	memset(names.buckets, -1, sizeof(int) * buckets);
+	memset(names.parent, -1, sizeof(int) * n);
+	return 0;
+}
 
-			//Read bitmaps
-			for(j = 0; j < 3 ; j++){	//bitmaps fill 3 blocks in memory
-				if(bread(DEVICE_IMAGE, j+2, buf + (j*BLOCK_SIZE)) == -1){
-					printf("[ERROR] Cannot mount the fs. Error reading bitmaps\n");
-					return -1;
-				}
-				else{
-					strncpy((char *) temp_buf + (j * BLOCK_SIZE), buf, BLOCK_SIZE);
-				}
-			}
+void name_close(void)
+{
+	free(names.buckets);
+	free(names.next);
+	free(names.hash);
+	free(names.parent);
+	bzero(&names, sizeof(struct name_index));
+}
 
-			//Read inodes
-			for(j = 0; j < 2 ; j++){	//inodes fill 2 blocks in memory
-				if(bread(DEVICE_IMAGE, (j + sblocks[0].firstinode), buf) == -1 ){
-					printf("[ERROR] Cannot mount the fs. Error reading inodes\n");
-					return -1;
-				}
-				else{
-					strncpy((char *) temp_buf + ((3 + j) * BLOCK_SIZE), buf, BLOCK_SIZE);
-				}
-			}
+/* Inode of the entry name of the directory d, from the index or else from the tree of d */
+int name_lookup(int d, char *name)
+{
+	unsigned int h = name_hash(name);
+	int i;
 
-			result = CRC32((const unsigned char *) temp_buf, 5*BLOCK_SIZE, sblocks[0].crc);
+	if(names.buckets == NULL){
+		return -1;
+	}
+	for(i = names.buckets[name_bucket(h, d)]; i != -1; i = names.next[i]){
+		if(names.hash[i] == h && names.parent[i] == d && !strcmp(inodes[i].name, name)){
+			return i;
+		}
+	}
+	if((i = dir_lookup(d, name, h)) != -1){
+		name_add(i, d);
+	}
+	return i;
+}
+
+/*
+ * Goes down the path from the root directory, up to its last component, which
+ * is copied to name.
+ * @return The directory of the last component, -1 if a directory on the way
+ * doesn't exist, -2 if the path has no last component or one is too long.
+ */
+int path_walk(char *path, char *name)
+{
+	int d = ROOT_INODE, n;
+	char *end;
+
+	name[0] = '\0';
+	while(1){
+		while(*path == '/'){
+			path++;
+		}
+		if(*path == '\0'){
+			break;
+		}
+		n = (end = strchr(path, '/')) != NULL ? end - path : strlen(path);
+		if(n > MAX_FILE_NAME){
+			return -2;
+		}
+		//The component before this one is a directory on the way
+		if(name[0] != '\0' && ((d = name_lookup(d, name)) == -1 || inodes[d].type != T_DIR)){
+			return -1;
+		}
+		memcpy(name, path, n);
+		name[n] = '\0';
+		path += n;
+	}
+	return name[0] != '\0' ? d : -2;
+}
+
+int namei(char *path)
+{
+	char name[MAX_FILE_NAME+1];
+	int d;
+
+	if((d = path_walk(path, name)) < 0){
+		return -1;
+	}
+	return name_lookup(d, name);
+}
+
+/* Makes room in the map for count extents */
+static int extent_room(struct extent_map *m, int count)
+{
+	int max = m->max > 0 ? m->max : INLINE_EXTENTS;
+	struct extent *ext;
+	unsigned int *first;
+
+	if(count <= m->max){
+		return 0;
+	}
+	while(max < count){
+		max *= 2;
+	}
+	if((ext = realloc(m->ext, sizeof(struct extent) * max)) == NULL){
+		return -1;
+	}
+	m->ext = ext;
+	if((first = realloc(m->first, sizeof(unsigned int) * max)) == NULL){
+		return -1;
+	}
+	m->first = first;
+	m->max = max;
+	return 0;
+}
+
+/* Adds the extent block b at the end of the chain of the map */
+static int chain_add(struct extent_map *m, unsigned int b)
+{
+	unsigned int *chain;
+
+	if((chain = realloc(m->chain, sizeof(unsigned int) * (m->nchain + 1))) == NULL){
+		return -1;
+	}
+	m->chain = chain;
+	m->chain[m->nchain++] = b;
+	return 0;
+}
+
+/*
+ * Loads the extents of the file i, from the inode and then from its extent
+ * blocks, which are read through the cache.
+ */
+int extent_load(int i)
+{
+	struct extent_map *m = &maps[i];
+	struct extent_block eb;
+	unsigned int b;
+	int j, k, n = inodes[i].numExtents;
+
+	//Files of LAYOUT_INDIRECT have their pointers in the inode
+	if(m->loaded || sblocks[0].fileLayout != LAYOUT_EXTENTS){
+		return 0;
+	}
+	if(extent_room(m, n) == -1){
+		return -1;
+	}
+	m->nchain = 0;
+	for(k = 0; k < n && k < INLINE_EXTENTS; k++){
+		m->ext[k] = inodes[i].extents[k];
+	}
+	for(b = inodes[i].extentBlock; k < n; b = eb.next){
+		if(bread(DEVICE_IMAGE, b + sblocks[0].firstDataBlock, (char *) &eb) == -1 || chain_add(m, b) == -1){
+			return -1;
+		}
+		for(j = 0; j < BLOCK_EXTENTS && k < n; j++, k++){
+			m->ext[k] = eb.extents[j];
+		}
+	}
+	for(k = 0; k < n; k++){
+		m->first[k] = k > 0 ? m->first[k-1] + m->ext[k-1].length : 0;
+	}
+	m->count = n;
+	m->loaded = 1;
+	return 0;
+}
+
+/* Frees the extents of the file i in memory */
+void extent_unload(int i)
+{
+	free(maps[i].ext);
+	free(maps[i].first);
+	free(maps[i].chain);
+	bzero(&maps[i], sizeof(struct extent_map));
+}
+
+/*
+ * Writes the extents of the file i from the extent from on to the inode and to
+ * the extent blocks that hold them, and the one before, which links to them.
+ */
+static int extent_store(int i, int from)
+{
+	struct extent_map *m = &maps[i];
+	struct extent_block eb;
+	int c, j, k;
+
+	for(k = from; k < m->count && k < INLINE_EXTENTS; k++){
+		inodes[i].extents[k] = m->ext[k];
+	}
+	inodes[i].numExtents = m->count;
+	inodes[i].extentBlock = m->nchain > 0 ? m->chain[0] : 0;
+
+	c = from < INLINE_EXTENTS ? 0 : (from - INLINE_EXTENTS) / BLOCK_EXTENTS;
+	for(c = c > 0 ? c - 1 : 0; c < m->nchain; c++){
+		bzero(&eb, BLOCK_SIZE);
+		eb.next = c + 1 < m->nchain ? m->chain[c+1] : 0;
+		for(j = 0, k = INLINE_EXTENTS + c * BLOCK_EXTENTS; j < BLOCK_EXTENTS && k < m->count; j++, k++){
+			eb.extents[j] = m->ext[k];
+		}
+		if(bwrite(DEVICE_IMAGE, m->chain[c] + sblocks[0].firstDataBlock, (char *) &eb) == -1){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Adds the run of length blocks from start at the end of the file i. The
+ * first extent that does not fit in the inode or in the last extent block
+ * takes a new extent block.
+ */
+static int extent_append(int i, unsigned int start, unsigned int length)
+{
+	struct extent_map *m = &maps[i];
+	int b;
+
+	if(extent_room(m, m->count + 1) == -1){
+		return -1;
+	}
+	if(m->count >= INLINE_EXTENTS && (m->count - INLINE_EXTENTS) % BLOCK_EXTENTS == 0){
+		if((b = balloc()) == -1){
+			return -1;
+		}
+		if(chain_add(m, b) == -1){
+			bfree_run(b, 1);
+			return -1;
+		}
+	}
+	m->first[m->count] = m->count > 0 ? m->first[m->count-1] + m->ext[m->count-1].length : 0;
+	m->ext[m->count].start = start;
+	m->ext[m->count].length = length;
+	m->count++;
+	return 0;
+}
+
+/*
+ * Finds the data block of the block number block of the file i, with a binary
+ * search on the extents, and in left how many blocks of the extent are left
+ * from it.
+ */
+static int extent_find(int i, unsigned int block, unsigned int *left)
+{
+	struct extent_map *m = &maps[i];
+	int lo = 0, hi = m->count - 1, mid;
+
+	if(m->count == 0 || block >= m->first[hi] + m->ext[hi].length){
+		return -1;
+	}
+	while(lo < hi){
+		mid = (lo + hi + 1) / 2;
+		if(m->first[mid] <= block){
+			lo = mid;
+		}
+		else{
+			hi = mid - 1;
+		}
+	}
+	if(left != NULL){
+		*left = m->ext[lo].length - (block - m->first[lo]);
+	}
+	return m->ext[lo].start + (block - m->first[lo]);
+}
+
+/*
+ * Allocates data blocks for the file i until it has blocks blocks, or the
+ * device is full. New blocks extend the last extent when they follow it.
+ * @return The number of blocks of the file, -1 in case of error.
+ */
+static int extent_grow(int i, unsigned int blocks)
+{
+	struct extent_map *m = &maps[i];
+	struct extent *last;
+	unsigned int total, hint;
+	int b, got, from;
+
+	if(extent_load(i) == -1){
+		return -1;
+	}
+	total = m->count > 0 ? m->first[m->count-1] + m->ext[m->count-1].length : 0;
+	from = m->count;
+	while(total < blocks){
+		last = m->count > 0 ? &m->ext[m->count-1] : NULL;
+		hint = last != NULL ? last->start + last->length : 0;
+		if((b = balloc_run(hint, blocks - total, &got)) == -1){
+			break;
+		}
+		if(last != NULL && b == hint){
+			last->length += got;
+			if(from > m->count - 1){
+				from = m->count - 1;
+			}
+		}
+		else if(extent_append(i, b, got) == -1){
+			bfree_run(b, got);
+			break;
+		}
+		total += got;
+	}
+	if(from < m->count && extent_store(i, from) == -1){
+		return -1;
+	}
+	return total;
+}
+
+/* Frees the data blocks and extent blocks of the file i */
+static int extent_free(int i)
+{
+	struct extent_map *m = &maps[i];
+	unsigned int b;
+	int j;
+
+	if(extent_load(i) == -1){
+		return -1;
+	}
+	for(j = 0; j < m->count; j++){
+		for(b = m->ext[j].start; b < m->ext[j].start + m->ext[j].length; b++){
+			if(bfree(b) == -1){
+				return -1;
+			}
+		}
+	}
+	for(j = 0; j < m->nchain; j++){
+		if(bfree(m->chain[j]) == -1){
+			return -1;
+		}
+	}
+	extent_unload(i);
+	inodes[i].numExtents = 0;
+	inodes[i].extentBlock = 0;
+	return 0;
+}
+
+/* Allocates a block for the data or the pointers of a file, after the last one */
+static int ptr_alloc(void)
+{
+	int b;
+
+	if((b = balloc()) == -1){
+		return -1;
+	}
+	return b + sblocks[0].firstDataBlock;
+}
+
+/* The block of pointers b, at depth d of the tree */
+static unsigned int *ptr_get(int d, unsigned int b)
+{
+	if(ptrs[d].block != b){
+		ptrs[d].block = 0;
+		if(bread(DEVICE_IMAGE, b, (char *) ptrs[d].ptr) == -1){
+			return NULL;
+		}
+		ptrs[d].block = b;
+	}
+	return ptrs[d].ptr;
+}
+
+/*
+ * Finds the device block of the block number block of the file i, going down
+ * the direct, single, double or triple indirect pointers. If allocate is set,
+ * missing blocks of pointers and data are allocated on the way, and new or
+ * changed blocks of pointers are written back. Otherwise a missing block is a
+ * hole. In left, which holds the most blocks the caller needs, it returns how
+ * many blocks from it follow in the device, or are holes too, with the same
+ * block of pointers.
+ * @return The device block, 0 for a hole, -1 in case of error.
+ */
+static int indirect_find(int i, unsigned int block, int allocate, unsigned int *left)
+{
+	unsigned int idx[3], span = BLOCK_PTRS, *slot, *base, parent = 0, k, n;
+	int level, d, b;
+
+	//Level 0 are the direct pointers, and the index in each block of pointers on the way down
+	if(block < NUM_DIRECT){
+		level = 0;
+		slot = &inodes[i].direct[block];
+	}
+	else{
+		block -= NUM_DIRECT;
+		for(level = 1; level <= 3 && block >= span; level++){
+			block -= span;
+			span *= BLOCK_PTRS;
+		}
+		if(level > 3){
+			return -1;
+		}
+		for(d = level - 1; d >= 0; d--){
+			idx[d] = block % BLOCK_PTRS;
+			block /= BLOCK_PTRS;
+		}
+		slot = &inodes[i].indirect[level - 1];
+	}
+
+	for(d = 0; d <= level; d++){
+		if(*slot == 0){
+			if(!allocate){
+				if(left != NULL){
+					*left = 1;
+				}
+				return 0;
+			}
+			if((b = ptr_alloc()) == -1){
+				return -1;
+			}
+			*slot = b;
+			if(parent != 0 && bwrite(DEVICE_IMAGE, parent, (char *) ptrs[d-1].ptr) == -1){
+				return -1;
+			}
+			if(d < level){	//A new block of pointers has no blocks under it yet
+				bzero(ptrs[d].ptr, BLOCK_SIZE);
+				ptrs[d].block = b;
+			}
+		}
+		if(d == level){
+			break;
+		}
+		parent = *slot;
+		if(ptr_get(d, parent) == NULL){
+			return -1;
+		}
+		slot = &ptrs[d].ptr[idx[d]];
+	}
+
+	if(left != NULL){
+		base = level == 0 ? inodes[i].direct : ptrs[level-1].ptr;
+		k = slot - base;
+		for(n = *left, *left = 1; *left < n && k + *left < (level == 0 ? NUM_DIRECT : BLOCK_PTRS); (*left)++){
+			if(base[k + *left] != (*slot != 0 ? *slot + *left : 0)){
+				break;
+			}
+		}
+	}
+	return *slot;
+}
+
+/* Frees the block b and, if it is a block of pointers of depth d above the data, every block under it */
+static int indirect_free(unsigned int b, int d)
+{
+	unsigned int ptr[BLOCK_PTRS];
+	int k;
+
+	if(d > 0){
+		if(bread(DEVICE_IMAGE, b, (char *) ptr) == -1){
+			return -1;
+		}
+		for(k = 0; k < BLOCK_PTRS; k++){
+			if(ptr[k] != 0 && indirect_free(ptr[k], d - 1) == -1){
+				return -1;
+			}
+		}
+	}
+	return bfree(b - sblocks[0].firstDataBlock);
+}
+
+_Static_assert(sizeof(struct dir_node) == BLOCK_SIZE, "A node of a directory tree must take one block");
+
+/* Order of the entries of a directory: by hash of the name, and then by inode */
+static int key_cmp(struct dir_key a, struct dir_key b)
+{
+	if(a.hash != b.hash){
+		return a.hash < b.hash ? -1 : 1;
+	}
+	return a.inode < b.inode ? -1 : a.inode > b.inode;
+}
+
+/* Number of the count keys that are smaller than k, or not greater if upper is set */
+static int key_search(struct dir_key *keys, int count, struct dir_key k, int upper)
+{
+	int lo = 0, hi = count, mid;
+
+	while(lo < hi){
+		mid = (lo + hi) / 2;
+		if(key_cmp(keys[mid], k) < (upper ? 1 : 0)){
+			lo = mid + 1;
+		}
+		else{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* Goes down the tree of the directory d to the leaf where k is or would be, which is read into node */
+static int dir_leaf(int d, struct dir_key k, struct dir_node *node)
+{
+	unsigned int b = inodes[d].dirRoot;
+
+	while(1){
+		if(bread(DEVICE_IMAGE, b, (char *) node) == -1){
+			return -1;
+		}
+		if(node->leaf){
+			return b;
+		}
+		b = node->child[key_search(node->keys, node->count, k, 1)];
+	}
+}
+
+/* Makes the tree of the new directory i, a single empty leaf */
+int dir_create(int i)
+{
+	struct dir_node node;
+	int b;
+
+	if((b = ptr_alloc()) == -1){
+		return -1;
+	}
+	bzero(&node, sizeof(struct dir_node));
+	node.leaf = 1;
+	if(bwrite(DEVICE_IMAGE, b, (char *) &node) == -1){
+		bfree(b - sblocks[0].firstDataBlock);
+		return -1;
+	}
+	inodes[i].dirRoot = b;
+	inodes[i].numEntries = 0;
+	return 0;
+}
+
+/* Inode of the entry name, whose hash is h, of the directory d, -1 if there is none */
+int dir_lookup(int d, char *name, unsigned int h)
+{
+	struct dir_key k = {h, 0};
+	struct dir_node node;
+	int j;
+
+	if(inodes[d].numEntries == 0 || dir_leaf(d, k, &node) == -1){
+		return -1;
+	}
+	//The names with the same hash can go on in the next leaves
+	for(j = key_search(node.entries, node.count, k, 0); ; j++){
+		if(j == node.count){
+			if(node.next == 0 || bread(DEVICE_IMAGE, node.next, (char *) &node) == -1){
+				return -1;
+			}
+			j = -1;
+			continue;
+		}
+		if(node.entries[j].hash != h){
+			return -1;
+		}
+		if(node.entries[j].inode < sblocks[0].numinodes && !strcmp(inodes[node.entries[j].inode].name, name)){
+			return node.entries[j].inode;
+		}
+	}
+}
+
+/*
+ * Adds k under the node b. If the node is full it is split, and the first key
+ * of the new node on its right is returned in up, and its block in right.
+ * @return 1 if the node was split, 0 if not, -1 in case of error.
+ */
+static int dir_insert(unsigned int b, struct dir_key k, struct dir_key *up, unsigned int *right)
+{
+	struct dir_node node, new;
+	struct dir_key keys[DIR_LEAF_KEYS + 1];
+	unsigned int child[DIR_NODE_KEYS + 2], r;
+	int j, half, split;
+
+	if(bread(DEVICE_IMAGE, b, (char *) &node) == -1){
+		return -1;
+	}
+
+	if(node.leaf){
+		j = key_search(node.entries, node.count, k, 0);
+		if(node.count < DIR_LEAF_KEYS){
+			memmove(&node.entries[j+1], &node.entries[j], sizeof(struct dir_key) * (node.count - j));
+			node.entries[j] = k;
+			node.count++;
+			return bwrite(DEVICE_IMAGE, b, (char *) &node) == -1 ? -1 : 0;
+		}
+		//Half of the entries go to a new leaf, linked after this one
+		memcpy(keys, node.entries, sizeof(struct dir_key) * j);
+		keys[j] = k;
+		memcpy(&keys[j+1], &node.entries[j], sizeof(struct dir_key) * (node.count - j));
+		if((r = ptr_alloc()) == -1){
+			return -1;
+		}
+		half = (DIR_LEAF_KEYS + 1) / 2;
+		bzero(&new, sizeof(struct dir_node));
+		new.leaf = 1;
+		new.count = DIR_LEAF_KEYS + 1 - half;
+		new.next = node.next;
+		memcpy(new.entries, &keys[half], sizeof(struct dir_key) * new.count);
+		node.count = half;
+		node.next = r;
+		memcpy(node.entries, keys, sizeof(struct dir_key) * half);
+		bzero(&node.entries[half], sizeof(struct dir_key) * (DIR_LEAF_KEYS - half));
+		*up = new.entries[0];
+	}
+	else{
+		j = key_search(node.keys, node.count, k, 1);
+		if((split = dir_insert(node.child[j], k, up, right)) <= 0){
+			return split;
+		}
+		if(node.count < DIR_NODE_KEYS){
+			memmove(&node.keys[j+1], &node.keys[j], sizeof(struct dir_key) * (node.count - j));
+			memmove(&node.child[j+2], &node.child[j+1], sizeof(unsigned int) * (node.count - j));
+			node.keys[j] = *up;
+			node.child[j+1] = *right;
+			node.count++;
+			return bwrite(DEVICE_IMAGE, b, (char *) &node) == -1 ? -1 : 0;
+		}
+		//The key in the middle goes up, the ones after it to a new node
+		memcpy(keys, node.keys, sizeof(struct dir_key) * j);
+		keys[j] = *up;
+		memcpy(&keys[j+1], &node.keys[j], sizeof(struct dir_key) * (node.count - j));
+		memcpy(child, node.child, sizeof(unsigned int) * (j + 1));
+		child[j+1] = *right;
+		memcpy(&child[j+2], &node.child[j+1], sizeof(unsigned int) * (node.count - j));
+		if((r = ptr_alloc()) == -1){
+			return -1;
+		}
+		half = (DIR_NODE_KEYS + 1) / 2;
+		bzero(&new, sizeof(struct dir_node));
+		new.count = DIR_NODE_KEYS - half;
+		memcpy(new.keys, &keys[half+1], sizeof(struct dir_key) * new.count);
+		memcpy(new.child, &child[half+1], sizeof(unsigned int) * (new.count + 1));
+		bzero(node.keys, sizeof(node.keys));
+		bzero(node.child, sizeof(node.child));
+		node.count = half;
+		memcpy(node.keys, keys, sizeof(struct dir_key) * half);
+		memcpy(node.child, child, sizeof(unsigned int) * (half + 1));
+		*up = keys[half];
+	}
+
+	*right = r;
+	if(bwrite(DEVICE_IMAGE, r, (char *) &new) == -1 || bwrite(DEVICE_IMAGE, b, (char *) &node) == -1){
+		return -1;
+	}
+	return 1;
+}
+
+/* Adds the inode i to the directory d. When the root splits, a new root goes above it */
+int dir_add(int d, int i)
+{
+	struct dir_key k = {name_hash(inodes[i].name), i}, up;
+	struct dir_node root;
+	unsigned int right;
+	int b, split;
+
+	if((split = dir_insert(inodes[d].dirRoot, k, &up, &right)) == -1){
+		return -1;
+	}
+	if(split){
+		if((b = ptr_alloc()) == -1){
+			return -1;
+		}
+		bzero(&root, sizeof(struct dir_node));
+		root.count = 1;
+		root.keys[0] = up;
+		root.child[0] = inodes[d].dirRoot;
+		root.child[1] = right;
+		if(bwrite(DEVICE_IMAGE, b, (char *) &root) == -1){
+			return -1;
+		}
+		inodes[d].dirRoot = b;
+	}
+	inodes[d].numEntries++;
+	return 0;
+}
+
+/* Removes the inode i from the directory d. Nodes left with few entries are not merged */
+int dir_del(int d, int i)
+{
+	struct dir_key k = {name_hash(inodes[i].name), i};
+	struct dir_node node;
+	int b, j;
+
+	if((b = dir_leaf(d, k, &node)) == -1){
+		return -1;
+	}
+	j = key_search(node.entries, node.count, k, 0);
+	if(j == node.count || key_cmp(node.entries[j], k) != 0){
+		return -1;
+	}
+	memmove(&node.entries[j], &node.entries[j+1], sizeof(struct dir_key) * (node.count - j - 1));
+	node.count--;
+	bzero(&node.entries[node.count], sizeof(struct dir_key));
+	if(bwrite(DEVICE_IMAGE, b, (char *) &node) == -1){
+		return -1;
+	}
+	inodes[d].numEntries--;
+	return 0;
+}
+
+/* Frees the node b of a directory tree and every node under it */
+int dir_free(unsigned int b)
+{
+	struct dir_node node;
+	int j;
+
+	if(bread(DEVICE_IMAGE, b, (char *) &node) == -1){
+		return -1;
+	}
+	if(!node.leaf){
+		for(j = 0; j <= node.count; j++){
+			if(dir_free(node.child[j]) == -1){
+				return -1;
+			}
+		}
+	}
+	return bfree(b - sblocks[0].firstDataBlock);
+}
+
+/*
+ * Finds the device block of the block number block of the file i, 0 if it is
+ * a hole, and in left, which holds the most blocks the caller needs, how many
+ * blocks from it follow in the device.
+ */
+static int file_map(int i, unsigned int block, unsigned int *left)
+{
+	int b;
+
+	if(sblocks[0].fileLayout == LAYOUT_INDIRECT){
+		return indirect_find(i, block, 0, left);
+	}
+	if((b = extent_find(i, block, left)) == -1){
+		return -1;
+	}
+	return b + sblocks[0].firstDataBlock;
+}
+
+/*
+ * Allocates the blocks of the file i from first to end. With LAYOUT_EXTENTS the
+ * blocks before first are allocated too.
+ * @return The block where the allocated blocks end, -1 in case of error.
+ */
+int file_grow(int i, unsigned int first, unsigned int end)
+{
+	unsigned int b;
+
+	if(sblocks[0].fileLayout != LAYOUT_INDIRECT){
+		return extent_grow(i, end);
+	}
+	for(b = first; b < end && indirect_find(i, b, 1, NULL) != -1; b++);
+	return b;
+}
+
+/* Frees every block of the file i */
+int file_free(int i)
+{
+	int k;
+
+	if(sblocks[0].fileLayout != LAYOUT_INDIRECT){
+		return extent_free(i);
+	}
+	for(k = 0; k < NUM_DIRECT; k++){
+		if(inodes[i].direct[k] != 0 && indirect_free(inodes[i].direct[k], 0) == -1){
+			return -1;
+		}
+	}
+	for(k = 0; k < 3; k++){
+		if(inodes[i].indirect[k] != 0 && indirect_free(inodes[i].indirect[k], k + 1) == -1){
+			return -1;
+		}
+	}
+	bzero(inodes[i].direct, sizeof(inodes[i].direct));
+	bzero(inodes[i].indirect, sizeof(inodes[i].indirect));
+	bzero(ptrs, sizeof(ptrs));
+	return 0;
+}
+
+/* Data block of the byte offset of the file i, -1 for a hole or in case of error: -1 is not a block to read */
+int bmap(int i, unsigned int offset)
+{
+	int b;
+
+	if(i>=sblocks[0].numinodes || i<0){
+		printf("[ERROR] Cannot locate data block. No valid data block id\n");
+		return -1;
+	}
+	if(extent_load(i) == -1){
+		printf("[ERROR] Cannot locate data block. Error reading extents\n");
+		return -1;
+	}
+
+	//Holes have no data block
+	if((b = file_map(i, offset / BLOCK_SIZE, NULL)) <= 0){
+		return -1;
+	}
+	return b - sblocks[0].firstDataBlock;
+}
+
+/*
+ * Reads or writes n bytes of buffer at offset of the file i, all in the same
+ * block, through a copy of the block.
+ */
+static int file_partial(int i, unsigned int offset, char *buffer, int n, int writing)
+{
+	char block[BLOCK_SIZE];
+	int b, start = offset % BLOCK_SIZE;
+
+	if((b = file_map(i, offset / BLOCK_SIZE, NULL)) == -1 || (writing && b == 0)){
+		return -1;
+	}
+
+	//A hole, or a block past the end of the file, has nothing to keep
+	if(b == 0 || (writing && offset - start >= inodes[i].size)){
+		bzero(block, BLOCK_SIZE);
+	}
+	else if(bread(DEVICE_IMAGE, b, block) == -1){
+		return -1;
+	}
+
+	if(!writing){
+		memcpy(buffer, block + start, n);
+		return 0;
+	}
+	memcpy(block + start, buffer, n);
+	return bwrite(DEVICE_IMAGE, b, block);
+}
+
+/*
+ * Reads or writes count whole blocks of the file i from offset, which is the
+ * start of a block, straight between buffer and the blocks. Consecutive blocks
+ * go in a single system call.
+ */
+static int file_blocks(int i, unsigned int offset, char *buffer, int count, int writing)
+{
+	struct bvec vec[FILE_VEC];
+	unsigned int left = 0;
+	int j, k, n, b = 0;
+
+	//The blocks are only looked for again when the run of the last ones ends
+	for(j = 0; j < count; j += k){
+		for(k = 0, n = 0; k < FILE_VEC && j + k < count; k++, left--){
+			if(left == 0){
+				left = count - (j + k);
+				if((b = file_map(i, offset / BLOCK_SIZE + j + k, &left)) == -1){
+					return -1;
+				}
+			}
+			if(b != 0){
+				vec[n].block = b++;
+				vec[n++].buffer = buffer + (j + k) * BLOCK_SIZE;
+			}
+			else if(writing){
+				return -1;
+			}
+			else{	//Holes read as zeros
+				bzero(buffer + (j + k) * BLOCK_SIZE, BLOCK_SIZE);
+			}
+		}
+		if(n > 0 && (writing ? bwritev(DEVICE_IMAGE, vec, n) : breadv(DEVICE_IMAGE, vec, n)) == -1){
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Reads or writes n bytes of buffer from the position of the file i. Only the
+ * blocks at the head and tail that are not whole are copied.
+ */
+int file_io(int i, char *buffer, int n, int writing)
+{
+	unsigned int offset = inodes[i].position;
+	int head, tail;
+
+	if(extent_load(i) == -1){
+		return -1;
+	}
+
+	head = (BLOCK_SIZE - offset % BLOCK_SIZE) % BLOCK_SIZE;
+	if(head > n){
+		head = n;
+	}
+	tail = head + (n - head) / BLOCK_SIZE * BLOCK_SIZE;
+
+	if(head > 0 && file_partial(i, offset, buffer, head, writing) == -1){
+		return -1;
+	}
+	if(tail > head && file_blocks(i, offset + head, buffer + head, (tail - head) / BLOCK_SIZE, writing) == -1){
+		return -1;
+	}
+	if(n > tail && file_partial(i, offset + tail, buffer + tail, n - tail, writing) == -1){
+		return -1;
+	}
+	return 0;
+}
+
+int myceil(double x){
+	int y = (int) x, result;
+	if((x - y) > 0){
+		result = y+1;
+	}
+	else{
+		result = y;
+	}
+
+	return result;
+}
+
+
+uint32_t CRCheck(int type, int i)
+{
+	uint32_t result = -1;
+	unsigned int offset, n;
+	char *temp_buf;
+	int j;
+
+	switch(type) {
+		case SB_ID: //Superblock: get metadata (inodes + bitmaps)
+			temp_buf = malloc((BITMAP_BLOCKS+INODE_BLOCKS)*BLOCK_SIZE); //bitmaps + inodes
+
+			//Read bitmaps and inodes, which the cache keeps since mountFS()
+			struct bvec vec[BITMAP_BLOCKS+INODE_BLOCKS];
+			for(j = 0; j < BITMAP_BLOCKS+INODE_BLOCKS ; j++){
+				vec[j].block = j < BITMAP_BLOCKS ? j+2 : j-BITMAP_BLOCKS + sblocks[0].firstinode;
+				vec[j].buffer = temp_buf + (j*BLOCK_SIZE);
+			}
+			if(breadv(DEVICE_IMAGE, vec, BITMAP_BLOCKS+INODE_BLOCKS) == -1){
+				printf("[ERROR] Cannot check the fs. Error reading metadata\n");
+				free(temp_buf);
+				return -1;
+			}
+
+			result = CRC32((const unsigned char *) temp_buf, (BITMAP_BLOCKS+INODE_BLOCKS)*BLOCK_SIZE, sblocks[0].crc);
 			free(temp_buf);
 		break;
 
 		case F_ID:
-			if(i<0 || i>=MAX_FILES){
+			if(i<0 || i>=MAX_INODES){
 				printf("[ERROR] Cannot execute CRC. No valid inode id\n");
 				return -1;
 			}
 
-			temp_buf = malloc(inodes[i].size);
-			int num_blocks = myceil(inodes[i].size/BLOCK_SIZE);
-
-			for(j = 0; j < num_blocks; j++){
-				if(bread(DEVICE_IMAGE, (j + inodes[i].directBlock), buf) == -1){
+			//The file goes through a buffer of FILE_VEC blocks, in pieces of the CRC. Holes are
+			//not read: file_blocks() gives zeros for them, as readFile() does
+			if((temp_buf = malloc(FILE_VEC * BLOCK_SIZE)) == NULL){
+				printf("[ERROR] Cannot execute CRC. Error allocating memory\n");
+				return -1;
+			}
+			if(extent_load(i) == -1){
+				printf("[ERROR] Cannot execute CRC. Error reading extents\n");
+				free(temp_buf);
+				return -1;
+			}
+			result = 0;
+			for(offset = 0; offset < inodes[i].size; offset += n){
+				n = inodes[i].size - offset < FILE_VEC * BLOCK_SIZE ? inodes[i].size - offset : FILE_VEC * BLOCK_SIZE;
+				if(file_blocks(i, offset, temp_buf, (n + BLOCK_SIZE - 1) / BLOCK_SIZE, 0) == -1){
 					printf("[ERROR] Cannot execute CRC. Error reading file\n");
+					free(temp_buf);
 					return -1;
 				}
-				else{
-					strncpy((char *) temp_buf + (j * BLOCK_SIZE), buf, BLOCK_SIZE);
-				}
+				result = crc32_update(result, (const unsigned char *) temp_buf, n);
 			}
-
-			result = CRC32((const unsigned char *) temp_buf, inodes[i].size, inodes[i].crc);
 			free(temp_buf);
 		break;
 
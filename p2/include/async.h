@@ -0,0 +1,72 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	async.h
+ * @brief 	Asynchronous block I/O on the open device.
+ * @date	01/03/2017
+ */
+
+#ifndef _ASYNC_H_
+#define _ASYNC_H_
+
+#define BIO_DEPTH 32		// Default number of requests in flight
+
+#define BIO_ANY 0			// io_uring if the kernel has it, or else threads
+#define BIO_URING 1			// io_uring
+#define BIO_THREADS 2		// A few threads doing pread()/pwrite()
+#define BIO_SYNC 3			// Done on submission, for RAM devices
+
+/*
+ * A request reads or writes count consecutive blocks from first. Requests go
+ * straight to the device: the cache is written back or dropped for their blocks
+ * on submission, and those blocks must not be used through bread()/bwrite()
+ * until the request completes. Completions are delivered by bio_poll() and
+ * bio_wait(), which set status and call done in the thread of the caller.
+ */
+typedef struct bio_req{
+	int first;							// first block
+	int count;							// number of blocks
+	char *buffer;						// count * BLOCK_SIZE bytes
+	int writing;						// 1 to write, 0 to read
+	int status;							// 0 if correct or -1, set on completion
+	void (*done)(struct bio_req *req);	// completion callback, can be NULL
+	void *arg;							// for the caller
+	struct bio_req *next;				// used by the engine
+} bio_req;
+
+/*
+ * @brief 	Starts the engine on the open device with up to depth requests in
+ * 			flight. engine is BIO_ANY, BIO_URING or BIO_THREADS.
+ * @return 	The engine started, -1 in case of error.
+ */
+int bio_init(int depth, int engine);
+
+/*
+ * @brief 	Submits n requests, in a single system call with io_uring. If the
+ * 			queue is full it waits for completions, delivering them.
+ * @return 	0 if every request was submitted, -1 if one has a wrong range or the
+ * 			engine is not started. Requests before the wrong one are submitted.
+ */
+int bio_submit(struct bio_req *reqs, int n);
+
+/*
+ * @brief 	Delivers the requests that have completed, without waiting.
+ * @return 	Number of requests delivered.
+ */
+int bio_poll(void);
+
+/*
+ * @brief 	Waits until at least min requests are delivered, or until none is
+ * 			left in flight.
+ * @return 	Number of requests delivered.
+ */
+int bio_wait(int min);
+
+/*
+ * @brief 	Waits for every request and stops the engine. It must be called
+ * 			before dev_close().
+ * @return 	0 if success, -1 otherwise.
+ */
+int bio_exit(void);
+
+#endif
@@ -9,8 +9,27 @@
 int ialloc();
 int ifree(int i);
 int balloc();
+int balloc_run(int hint, int want, int *got);
+void bfree_run(int b, int count);
+void bitmap_count(void);
 int bfree(int b);
-int namei(char *name);
-int bmap(int i, int offset);
+int namei(char *path);
+int name_open(void);
+void name_close(void);
+void name_add(int i, int d);
+void name_del(int i);
+int name_lookup(int d, char *name);
+int path_walk(char *path, char *name);
+int dir_create(int i);
+int dir_lookup(int d, char *name, unsigned int h);
+int dir_add(int d, int i);
+int dir_del(int d, int i);
+int dir_free(unsigned int b);
+int bmap(int i, unsigned int offset);
+int extent_load(int i);
+void extent_unload(int i);
+int file_grow(int i, unsigned int first, unsigned int end);
+int file_free(int i);
+int file_io(int i, char *buffer, int n, int writing);
 int myceil(double x);
 uint32_t CRCheck(int type, int i);
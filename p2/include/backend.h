@@ -0,0 +1,77 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	backend.h
+ * @brief 	Interface of the backends behind the device handle.
+ * @date	01/03/2017
+ */
+
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include <sys/uio.h>
+
+#include "blocks_cache.h"
+
+/*
+ * Operations of a backend of the open device. blocks_cache.c opens the file,
+ * checks the block numbers against its size and closes it after close(). The
+ * RAM backend gets no file, fd is -1.
+ */
+struct backend {
+	int memory;					// 1 if the blocks are already in memory, so they are not cached
+	int (*open)(char *name, int fd, off_t size);
+	int (*block)(int blockNumber, char *buffer, int writing);
+	int (*blocks)(int first, struct iovec *iov, int count, int writing);	// count consecutive blocks, NULL to use block()
+	int (*sync)(void);			// makes the writes durable
+	int (*close)(void);
+};
+
+extern struct backend pread_backend, mmap_backend, ram_backend;
+
+/*
+ * @brief 	Size of the RAM device called name.
+ * @return 	The size in bytes, -1 if there is no RAM device with that name.
+ */
+off_t ram_size(char *name);
+
+/*
+ * @brief 	Transfers a whole block of fd with pread()/pwrite(), retrying on
+ * 			signals and short transfers.
+ * @return 	0 if success, -1 otherwise.
+ */
+int fd_block(int fd, int blockNumber, char *buffer, int writing);
+
+/*
+ * @brief 	Transfers count consecutive blocks of fd from first with preadv()/
+ * 			pwritev(), one block per entry of iov, which is modified.
+ * @return 	0 if success, -1 otherwise.
+ */
+int fd_blocks(int fd, int first, struct iovec *iov, int count, int writing);
+
+/*
+ * Transfers of the open device that do not go through the cache, for async.c.
+ */
+
+/*
+ * @brief 	Descriptor of the open device.
+ * @return 	The descriptor, -1 if no device is open or it is a RAM device.
+ */
+int dev_fd(void);
+
+/*
+ * @brief 	Checks that the count blocks from first are in the open device and
+ * 			gets the cache ready for a transfer that does not use it: dirty
+ * 			blocks are written before a read and blocks are dropped before a
+ * 			write.
+ * @return 	0 if success, -1 otherwise.
+ */
+int dev_prepare(int first, int count, int writing);
+
+/*
+ * @brief 	Transfers count blocks from first with the backend, block by block.
+ * @return 	0 if success, -1 otherwise.
+ */
+int dev_range(int first, char *buffer, int count, int writing);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	cache.h
+ * @brief 	Buffer cache of the blocks of the open device.
+ * @date	01/03/2017
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#define CACHE_FRAMES 64		// Default number of frames, in blocks
+
+#define CACHE_LRU 0			// Replace the least recently used block
+#define CACHE_2Q 1			// Keep the blocks used more than once from being replaced by scans
+
+/*
+ * While a device is open with dev_open(), bread() and bwrite() on it go through
+ * a cache of whole blocks. Blocks are found by a hash on their number and
+ * replaced as the policy chooses. Writes stay in the cache until the block
+ * is replaced, cache_flush() is called or the device is closed.
+ */
+
+typedef struct cache_stats{
+	long hits;			// Reads and writes of a block in the cache
+	long misses;		// Reads and writes of a block not in the cache
+	long evictions;		// Blocks replaced to make room for others
+	long writebacks;	// Dirty blocks written to the device
+} cache_stats;
+
+/*
+ * @brief 	Sets the number of frames of the cache, 0 disables it. It takes effect
+ * 			on the next dev_open().
+ * @return 	0 if success, -1 otherwise.
+ */
+int cache_frames(int frames);
+
+/*
+ * @brief 	Sets the replacement policy of the cache, CACHE_LRU or CACHE_2Q (the
+ * 			default). It takes effect on the next dev_open().
+ * @return 	0 if success, -1 otherwise.
+ */
+int cache_policy(int policy);
+
+/*
+ * @brief 	Writes every dirty block of the cache to the device.
+ * @return 	0 if success, -1 otherwise.
+ */
+int cache_flush(void);
+
+/*
+ * @brief 	Copies the counters of the cache, which start at 0 on dev_open().
+ */
+void cache_getstats(struct cache_stats *stats);
+
+#endif
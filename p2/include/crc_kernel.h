@@ -0,0 +1,40 @@
+/*
+ * OPERATING SYSTEMS DESING - 17/18
+ *
+ * @file 	crc_kernel.h
+ * @brief 	Choice of the code that computes CRC16(), CRC32() and CRC64(), and
+ * 			CRC32 computed in pieces.
+ * @date	04/03/2018
+ */
+
+#ifndef _CRC_KERNEL_H_
+#define _CRC_KERNEL_H_
+
+#include <stdint.h>
+
+#define CRC_ANY 0			// The fastest kernel the CPU has (default)
+#define CRC_BYTE 1			// A table lookup per byte
+#define CRC_SLICE 2			// Slicing-by-8: eight table lookups per 8 bytes
+#define CRC_HW 3			// Carry-less multiply on x86 (PCLMULQDQ), CRC32 instructions on ARMv8
+
+/*
+ * Every kernel gives the same results. On ARMv8 only CRC32() has instructions
+ * of its own; CRC_HW uses slicing-by-8 for CRC16() and CRC64() there.
+ */
+
+/*
+ * @brief 	Sets the kernel used from now on, CRC_ANY, CRC_BYTE, CRC_SLICE or
+ * 			CRC_HW. It is chosen with CRC_ANY on the first CRC if not set.
+ * @return 	The kernel set, -1 if the CPU cannot run it.
+ */
+int crc_kernel(int kernel);
+
+/*
+ * @brief 	Goes on with the CRC32 crc of the data before buffer, as crc32() of
+ * 			zlib does: starting from 0, the pieces of a buffer give the same
+ * 			result as CRC32() of the whole buffer, which does not chain.
+ * @return 	The CRC32 of the data before buffer followed by buffer.
+ */
+uint32_t crc32_update(uint32_t crc, const unsigned char *buffer, unsigned int length);
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	device.h
+ * @brief 	Handle of the device used by bread() and bwrite().
+ * @date	01/03/2017
+ */
+
+#ifndef _DEVICE_H_
+#define _DEVICE_H_
+
+#include "blocks_cache.h"
+
+#define DEV_PREAD 0		// pread()/pwrite() on the file, through the cache (default)
+#define DEV_MMAP 1		// The file mapped in memory, without cache
+
+#define RAM_HUGEPAGES 1	// Back a RAM device with huge pages if possible
+
+/*
+ * @brief 	Opens the device and keeps it open until dev_close(). While it is open,
+ * 			bread() and bwrite() on it go to the backend chosen with
+ * 			dev_backend(), which makes at most one system call per block.
+ * 			If there is a RAM device with that name it is opened instead of
+ * 			the file. Opening the device that is already open does nothing.
+ * @return 	0 if success, -1 otherwise.
+ */
+int dev_open(char *deviceName);
+
+/*
+ * @brief 	Closes the device opened by dev_open(), writing the cache back. The
+ * 			mmap backend also waits for msync().
+ * @return 	0 if success, -1 otherwise.
+ */
+int dev_close(void);
+
+/*
+ * @brief 	Sets the backend of the device, DEV_PREAD or DEV_MMAP. It takes effect
+ * 			on the next dev_open().
+ * @return 	0 if success, -1 otherwise.
+ */
+int dev_backend(int backend);
+
+/*
+ * @brief 	Writes the cache to the device and waits until the backend has made
+ * 			every write durable (fsync() or msync()).
+ * @return 	0 if success, -1 otherwise.
+ */
+int dev_sync(void);
+
+/*
+ * @brief 	Size of the open device, read once by dev_open().
+ * @return 	The size in bytes, -1 if no device is open.
+ */
+long dev_size(void);
+
+/*
+ * Vectored access: one call for many blocks. On the open device, consecutive
+ * blocks that are not in the cache are transferred with a single system call
+ * (preadv()/pwritev()). Reads that miss are put in the cache, writes that miss
+ * go around it.
+ */
+
+/* A block of a vectored transfer */
+typedef struct bvec{
+	int block;			// block number
+	char *buffer;		// BLOCK_SIZE bytes
+	int status;			// set by the call: 0 if transferred, -1 otherwise
+} bvec;
+
+/*
+ * @brief 	Reads vec[i].block into vec[i].buffer for the count segments.
+ * @return 	0 if every segment was read, -1 otherwise.
+ */
+int breadv(char *deviceName, struct bvec *vec, int count);
+
+/*
+ * @brief 	Writes vec[i].buffer into vec[i].block for the count segments. If a
+ * 			block is repeated the last segment is the one written.
+ * @return 	0 if every segment was written, -1 otherwise.
+ */
+int bwritev(char *deviceName, struct bvec *vec, int count);
+
+/*
+ * RAM devices live in anonymous memory until they are destroyed or the process
+ * ends. They are opened by name like files, so creating one called
+ * DEVICE_IMAGE makes mkFS() and mountFS() work in memory.
+ */
+
+/*
+ * @brief 	Creates a RAM device of size bytes, a multiple of BLOCK_SIZE, filled
+ * 			with zeros. flags can be RAM_HUGEPAGES.
+ * @return 	0 if success, -1 otherwise.
+ */
+int ram_create(char *name, long size, int flags);
+
+/*
+ * @brief 	Creates a RAM device with the contents of the file path.
+ * @return 	0 if success, -1 otherwise.
+ */
+int ram_load(char *name, char *path, int flags);
+
+/*
+ * @brief 	Writes the contents of a RAM device to the file path, which can then
+ * 			be used as a device or loaded again.
+ * @return 	0 if success, -1 otherwise.
+ */
+int ram_snapshot(char *name, char *path);
+
+/*
+ * @brief 	Frees a RAM device that is not open.
+ * @return 	0 if success, -1 otherwise.
+ */
+int ram_destroy(char *name);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	directory.h
+ * @brief 	Directories of the file system.
+ * @date	01/03/2017
+ */
+
+#ifndef _DIRECTORY_H_
+#define _DIRECTORY_H_
+
+/*
+ * Every name the file system takes is a path, like "/docs/notes.txt", with
+ * components of up to MAX_FILE_NAME characters separated by '/'. The leading
+ * '/' can be left out, so a name without any '/' is a file of the root
+ * directory, made by mkFS(). The entries of each directory are kept on the
+ * device in a B+tree sorted by the hash of their names, read through the cache.
+ *
+ * A leaf holds DIR_LEAF_KEYS (254) entries, more than the MAX_FILES inodes, so
+ * with these limits a tree never splits. The splits are tested by test_dirs,
+ * built with a fan-out of 4 entries and 3 keys.
+ */
+
+/*
+ * @brief 	Creates a new directory, provided it doesn't exist in the file system.
+ * @return 	0 if success, -1 if it already exists, -2 in case of error.
+ */
+int mkDir(char *path);
+
+/*
+ * @brief 	Deletes a directory, provided it exists and is empty.
+ * @return 	0 if success, -1 if it does not exist, -2 in case of error.
+ */
+int rmDir(char *path);
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * OPERATING SYSTEMS DESING - 16/17
+ *
+ * @file 	layout.h
+ * @brief 	How the blocks of the files are found.
+ * @date	01/03/2017
+ */
+
+#ifndef _LAYOUT_H_
+#define _LAYOUT_H_
+
+#define LAYOUT_EXTENTS 0	// Runs of consecutive blocks, for large files written in order (default)
+#define LAYOUT_INDIRECT 1	// Direct and indirect pointers, for sparse files
+
+/*
+ * Every file of a file system uses the layout chosen when it was made. With
+ * LAYOUT_INDIRECT, the blocks a file skips with lseekFile() past its end are
+ * holes: they are not allocated and read as zeros. With LAYOUT_EXTENTS they are
+ * allocated when the file is written after them.
+ */
+
+/*
+ * @brief 	Sets the layout of the files, LAYOUT_EXTENTS or LAYOUT_INDIRECT. It
+ * 			takes effect on the next mkFS().
+ * @return 	0 if success, -1 otherwise.
+ */
+int fs_layout(int layout);
+
+#endif
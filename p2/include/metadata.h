@@ -7,23 +7,40 @@
  */
 
 #define MAX_FILES 40				//NF1
+#define MAX_INODES (MAX_FILES + 1)	//The files and directories, and the root directory
 #define MAX_FILE_NAME 32			//NF2
-//#define MAX_FILE_SIZE 1048576		//NF3 (1 MiB)
+#define MAX_FILE_SIZE 0xFFFFF800U	//NF3, lifted from 1 MiB to 4 GiB minus a block, as sizes are unsigned int
 //#define BLOCK_SIZE 2048				//NF4
-#define MAX_BLOCKS 5120				//Obtained from [ (MAX_DISK_SIZE-(MAX_FILES+5))/BLOCK_SIZE ]
+#define MAX_BLOCKS 16320			//Bits of the block of the bitmap, minus the ones of the inodes
+#define BITMAP_BLOCKS 1		//Blocks of the bitmap
+#define GROUP_BLOCKS 512	//Data blocks of each group of the bitmap, which has its count of free blocks
 #define MIN_DISK_SIZE 51200
-#define MAX_DISK_SIZE 10485760
-#define NUM_INODES 64		//64 inodes need exactly 2 blocks
+#define MAX_DISK_SIZE 33437696	//The 7 blocks of metadata and MAX_BLOCKS data blocks, just under 32 MiB
+#define NUM_INODES 64		//64 inodes need exactly 4 blocks
+#define INODE_BLOCKS 4		//Blocks of the inodes
+#define INLINE_EXTENTS 8	//Extents kept in the inode
+#define BLOCK_EXTENTS 255	//Extents in an extent block
+#define NUM_DIRECT 15		//Direct pointers of an inode
+#define BLOCK_PTRS 512		//Pointers in an indirect block
+#ifndef DIR_LEAF_KEYS
+#define DIR_LEAF_KEYS 254	//Entries in a leaf of a directory tree, at most 254
+#endif
+#ifndef DIR_NODE_KEYS
+#define DIR_NODE_KEYS 169	//Keys in an inner node of a directory tree, at most 169
+#endif
+#define DIR_NODE_BYTES 2032	//A node without its header, so that it takes one block
+#define ROOT_INODE 0		//Inode of the root directory
 //#define MAX_OPEN_FILES 3	//Not defined in statement
 
 #define CLOSE 0
 #define OPEN 1
 #define SB_ID 0
 #define F_ID 1
+#define T_FILE 0
+#define T_DIR 1
 
-#define SB_PADDING 2012		//To complete 1 Block
-#define I_PADDING 7			//To complete 64 bytes
-#define BM_PADDING 984		//To complete 3 blocks
+#define SB_PADDING 2008		//To complete 1 Block
+#define I_PADDING 3			//To complete 128 bytes
 
 
 #define bitmap_getbit(bitmap_, i_) (bitmap_[i_ >> 3] & (1 << (i_ & 0x07)))
@@ -42,22 +59,70 @@ typedef struct superblock{
 	unsigned int dataNumBlock;		//Number of data blocks in the device
 	unsigned int firstDataBlock;	// Number fo first data block
 	unsigned int deviceSize;		// Total disk space
+	unsigned int fileLayout;		// LAYOUT_EXTENTS or LAYOUT_INDIRECT
 	uint32_t crc;					//cr value for checking integrity
 	char padding[SB_PADDING];		//Padding field to fulfill a block
 } superblock;
 
+typedef struct extent{
+	unsigned int start;				//First data block of the run
+	unsigned int length;			//Number of data blocks of the run
+} extent;
+
 typedef struct inode{
-	char name[MAX_FILE_NAME+1];		//File name
+	char name[MAX_FILE_NAME+1];		//File name, the last component of its path
 	unsigned int size;				//Current file size in bytes
-	unsigned int directBlock;		//Direct block number
 	unsigned int position;			//Seek pointer position
 	unsigned int status;			//OPEN/CLOSE
 	uint32_t crc; 					//cr value for checking integrity
+	union{
+		struct{		//LAYOUT_EXTENTS
+			unsigned int numExtents;		//Number of extents of the file
+			unsigned int extentBlock;		//First extent block, if numExtents > INLINE_EXTENTS
+			struct extent extents[INLINE_EXTENTS];	//First extents, in file order
+		};
+		struct{		//LAYOUT_INDIRECT, device blocks or 0 for holes
+			unsigned int direct[NUM_DIRECT];	//First blocks of the file
+			unsigned int indirect[3];		//Single, double and triple indirect blocks
+		};
+		struct{		//T_DIR
+			unsigned int dirRoot;			//Root node of the tree of entries
+			unsigned int numEntries;		//Number of entries
+		};
+	};
+	unsigned char type;				//T_FILE/T_DIR
 	char padding[I_PADDING];		//Padding field to fill a block
 } inode;
 
+typedef struct extent_block{
+	unsigned int next;				//Next extent block, if there are more extents
+	unsigned int unused;
+	struct extent extents[BLOCK_EXTENTS];	//Next extents, in file order
+} extent_block;
+
+/* Entries of a directory are sorted by the hash of their name, and then by inode */
+typedef struct dir_key{
+	unsigned int hash;				//Hash of the name
+	unsigned int inode;				//Inode of the entry
+} dir_key;
+
+/* Node of the B+tree of a directory */
+typedef struct dir_node{
+	unsigned int leaf;				//1 for a leaf, 0 for an inner node
+	unsigned int count;				//Number of entries or keys
+	unsigned int next;				//Next leaf, 0 if it is the last one
+	unsigned int unused;
+	union{
+		char bytes[DIR_NODE_BYTES];				//Smaller fan-outs leave the rest of the block unused
+		struct dir_key entries[DIR_LEAF_KEYS];	//Leaf: the entries, sorted
+		struct{		//Inner node: child[i] has the keys from keys[i-1] on, and below keys[i]
+			struct dir_key keys[DIR_NODE_KEYS];
+			unsigned int child[DIR_NODE_KEYS+1];
+		};
+	};
+} dir_node;
+
 typedef struct fs_bitmap{
-	char inodes_map[MAX_FILES];
-	char dataBlocks_map[MAX_BLOCKS];
-	char padding[BM_PADDING];		// Padding field to fill three blocks
+	uint64_t inodes_map[NUM_INODES/64];			//One bit per inode, 1 if used
+	uint64_t dataBlocks_map[MAX_BLOCKS/64];		//One bit per data block, 1 if used
 } fs_bitmap;
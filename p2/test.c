@@ -7,8 +7,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "include/filesystem.h"
+#include "include/device.h"
+#include "include/directory.h"
+#include "include/layout.h"
+#include "include/metadata.h"
 
 
 // Color definitions for asserts
@@ -19,12 +25,125 @@
 
 #define N_BLOCKS	25						// Number of blocks in the device
 #define DEV_SIZE 	N_BLOCKS * BLOCK_SIZE	// Device size, in bytes
+#define DATA_SIZE	5000					// Largest file written, over three blocks
+#define CHUNK_SIZE	(1 << 20)				// Bytes written at a time to fill the largest device
+#define SPARSE_OFFSET (8 << 20)				// Where the data of the sparse file starts, past the double indirect block
 
+static const int sizes[] = {100, 2048, DATA_SIZE};	// Less than a block, a whole block, a partial last block
+static const char *names[] = {"small.bin", "block.bin", "large.bin"};
 
-int main() {
-	int ret;
+
+/* Fills buf with binary data of the given seed, with NUL bytes in it */
+static void fill(char *buf, int size, int seed) {
+	int i;
+
+	for(i = 0; i < size; i++){
+		buf[i] = (i * 7 + seed) % 5 == 0 ? 0 : (char) (i * 31 + seed);
+	}
+}
+
+/* Opens the file, which must pass its integrity check, and reads back the data of seed from its start */
+static int reopen_read(const char *name, int size, int seed) {
+	char expected[DATA_SIZE], buf[DATA_SIZE + 1];
+	int fd;
+
+	fill(expected, size, seed);
+	//The seek pointer is kept from the last time the file was open
+	if((fd = openFile((char *) name)) < 0 || lseekFile(fd, 0, FS_SEEK_BEGIN) != 0){
+		return -1;
+	}
+	if(readFile(fd, buf, DATA_SIZE + 1) != size || memcmp(buf, expected, size) != 0){
+		closeFile(fd);
+		return -1;
+	}
+	return closeFile(fd);
+}
+
+/* Opens the sparse file, which must pass its integrity check, and reads the end of its hole and its data */
+static int sparse_read(void) {
+	char expected[BLOCK_SIZE + 100], buf[BLOCK_SIZE + 100];
+	int fd;
+
+	bzero(expected, BLOCK_SIZE);
+	fill(expected + BLOCK_SIZE, 100, 7);
+	if((fd = openFile("sparse.bin")) < 0 || lseekFile(fd, 0, FS_SEEK_BEGIN) != 0 || lseekFile(fd, SPARSE_OFFSET - BLOCK_SIZE, FS_SEEK_CUR) != 0){
+		return -1;
+	}
+	if(readFile(fd, buf, sizeof(buf)) != sizeof(buf) || memcmp(buf, expected, sizeof(buf)) != 0){
+		closeFile(fd);
+		return -1;
+	}
+	return closeFile(fd);
+}
+
+/* Fills the largest device with a file, 1 MiB at a time, and reads it back after mounting again */
+static int large_device(void) {
+	char *buf = malloc(CHUNK_SIZE), *expected = malloc(CHUNK_SIZE);
+	long total = 0;
+	int fd, n = CHUNK_SIZE, chunk, ret = -1;
+
+	if(buf == NULL || expected == NULL || mkFS(MAX_DISK_SIZE + BLOCK_SIZE) != -1 || mkFS(MAX_DISK_SIZE) != 0 || mountFS() != 0){
+		goto out;
+	}
+	if(createFile("fill.bin") != 0 || (fd = openFile("fill.bin")) < 0){
+		goto out;
+	}
+	for(chunk = 0; n == CHUNK_SIZE; chunk++, total += n){
+		fill(buf, CHUNK_SIZE, chunk);
+		if((n = writeFile(fd, buf, CHUNK_SIZE)) < 0){
+			goto out;
+		}
+	}
+	//Every data block the bitmap has room for, but the ones of the root directory and the extents, is in the file
+	if(total < (long) (MAX_BLOCKS - 64) * BLOCK_SIZE || closeFile(fd) != 0 || unmountFS() != 0){
+		goto out;
+	}
+
+	if(mountFS() != 0 || (fd = openFile("fill.bin")) < 0 || lseekFile(fd, 0, FS_SEEK_BEGIN) != 0){
+		goto out;
+	}
+	for(chunk = 0; total > 0; chunk++, total -= n){
+		fill(expected, CHUNK_SIZE, chunk);
+		n = total < CHUNK_SIZE ? total : CHUNK_SIZE;
+		if(readFile(fd, buf, CHUNK_SIZE) != n || memcmp(buf, expected, n) != 0){
+			goto out;
+		}
+	}
+	if(closeFile(fd) == 0 && unmountFS() == 0){
+		ret = 0;
+	}
+out:
+	free(buf);
+	free(expected);
+	return ret;
+}
+
+/* Creates the file, writes size bytes of seed, closes it and reads them back after opening it again */
+static int write_reopen_read(const char *name, int size, int seed) {
+	char buf[DATA_SIZE];
+	int fd;
+
+	fill(buf, size, seed);
+	if(createFile((char *) name) != 0 || (fd = openFile((char *) name)) < 0){
+		return -1;
+	}
+	if(writeFile(fd, buf, size) != size || closeFile(fd) != 0){
+		return -1;
+	}
+	return reopen_read(name, size, seed);
+}
+
+
+/* With "ram" as argument the test runs on a RAM device instead of disk.dat */
+int main(int argc, char *argv[]) {
+	int ret, i;
 	//int ret1;
 
+	if(argc > 1 && strcmp(argv[1], "ram") == 0 && ram_create(DEVICE_IMAGE, DEV_SIZE, RAM_HUGEPAGES) == -1) {
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST ram_create ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+
 	///////
 	printf("Starting test...\n");
 	ret = mkFS(DEV_SIZE);
@@ -55,6 +174,35 @@ int main() {
 
 	///////
 
+	ret = mkDir("/docs");
+	if(ret != 0 || createFile("/docs/notes.txt") != 0 || rmDir("/docs") != -2) {
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mkDir ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mkDir ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+	///////
+
+	ret = removeFile("/docs/notes.txt");
+	if(ret != 0 || rmDir("/docs") != 0 || openFile("/docs/notes.txt") != -1) {
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST rmDir ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST rmDir ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+	///////
+
+	for(i = 0, ret = 0; i < 3 && ret == 0; i++){
+		ret = write_reopen_read(names[i], sizes[i], i);
+	}
+	if(ret != 0) {
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST writeFile/readFile ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST writeFile/readFile ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+	///////
+
 	ret = unmountFS();
 	if(ret != 0) {
 		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST unmountFS ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
@@ -62,6 +210,47 @@ int main() {
 	}
 	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST unmountFS ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
 
+	///////
+
+	ret = mountFS();
+	for(i = 0; i < 3 && ret == 0; i++){
+		ret = reopen_read(names[i], sizes[i], i);
+	}
+	if(ret != 0 || unmountFS() != 0) {
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST readFile after mountFS ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST readFile after mountFS ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+	///////
+
+	//With LAYOUT_INDIRECT the file is a hole up to SPARSE_OFFSET, far larger than the device
+	char data[100];
+	fill(data, 100, 7);
+	fs_layout(LAYOUT_INDIRECT);
+	ret = mkFS(DEV_SIZE) != 0 || mountFS() != 0 || createFile("sparse.bin") != 0;
+	if(ret == 0 && ((i = openFile("sparse.bin")) < 0 || lseekFile(i, SPARSE_OFFSET, FS_SEEK_CUR) != 0 ||
+			writeFile(i, data, 100) != 100 || closeFile(i) != 0)){
+		ret = -1;
+	}
+	if(ret != 0 || sparse_read() != 0 || unmountFS() != 0 || mountFS() != 0 || sparse_read() != 0 || unmountFS() != 0) {
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST sparse file ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fs_layout(LAYOUT_EXTENTS);
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST sparse file ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+	///////
+
+	//The largest device is made in memory, in place of the one of the other tests
+	ram_destroy(DEVICE_IMAGE);
+	if(ram_create(DEVICE_IMAGE, MAX_DISK_SIZE + BLOCK_SIZE, 0) == -1 || large_device() != 0) {
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST largest device ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	ram_destroy(DEVICE_IMAGE);
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST largest device ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
 	///////
 	/*
 	//File that exists
@@ -0,0 +1,88 @@
+/*
+ * OPERATING SYSTEMS DESING - 17/18
+ *
+ * @file 	test_dirs.c
+ * @brief 	Test of the splits of the directory trees.
+ *
+ * Built with a fan-out of DIR_LEAF_KEYS entries and DIR_NODE_KEYS keys small
+ * enough for the MAX_FILES inodes to split the leaves and the inner nodes of a
+ * directory. Its files are created, looked up, half removed, looked up again
+ * after mounting, created again and removed, and the empty directory deleted.
+ *
+ * Usage: make test_dirs && ./test_dirs
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "include/filesystem.h"
+#include "include/device.h"
+#include "include/directory.h"
+#include "include/metadata.h"
+
+#define DEV_SIZE	(100 * BLOCK_SIZE)		// Room for the nodes of a tree of one entry per file
+#define NUM_NAMES	(MAX_FILES - 1)			// Every inode but the one of the directory
+
+#if DIR_LEAF_KEYS * 2 > NUM_NAMES || DIR_NODE_KEYS * DIR_LEAF_KEYS > NUM_NAMES
+#error "Build with a fan-out small enough to split the inner nodes, see the Makefile"
+#endif
+
+static int failed = 0;
+
+static void report(const char *test, int ok) {
+	printf("TEST %s %s\n", test, ok ? "SUCCESS" : "FAILED");
+	failed += !ok;
+}
+
+static char *name(int n) {
+	static char path[32];
+
+	sprintf(path, "/big/file%02d", n);
+	return path;
+}
+
+/* Whether every name of the given parity (-1 for all) can be opened and every other one cannot */
+static int lookup(int present) {
+	int n, fd, want;
+
+	for(n = 0; n < NUM_NAMES; n++){
+		want = present == -1 || n % 2 == present;
+		fd = openFile(name(n));
+		if(want ? fd < 0 || closeFile(fd) != 0 : fd != -1){
+			printf("[ERROR] %s is %s\n", name(n), want ? "lost" : "still there");
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Creates (or removes) the names of the given parity, -1 for all */
+static int each(int parity, int create) {
+	int n;
+
+	for(n = 0; n < NUM_NAMES; n++){
+		if((parity == -1 || n % 2 == parity) && (create ? createFile(name(n)) : removeFile(name(n))) != 0){
+			printf("[ERROR] cannot %s %s\n", create ? "create" : "remove", name(n));
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	if(ram_create(DEVICE_IMAGE, DEV_SIZE, 0) == -1 || mkFS(DEV_SIZE) != 0 || mountFS() != 0 || mkDir("/big") != 0){
+		printf("[ERROR] cannot make the file system\n");
+		return -1;
+	}
+
+	report("create", each(-1, 1) && createFile(name(0)) == -1);
+	report("lookup", lookup(-1));
+	report("remove half", each(1, 0) && lookup(0) && removeFile(name(1)) == -1);
+	report("lookup after mountFS", unmountFS() == 0 && mountFS() == 0 && lookup(0));
+	report("create again", each(1, 1) && lookup(-1));
+	report("remove all", each(-1, 0) && rmDir("/big") == 0 && mkDir("/big") == 0);
+	report("unmountFS", unmountFS() == 0);
+
+	printf("test_dirs: %s\n", failed ? "FAILED" : "OK");
+	return failed ? -1 : 0;
+}